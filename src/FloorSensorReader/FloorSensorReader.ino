@@ -2,163 +2,642 @@
    Neopixel Kalimba, for Zoom Museum Vienna, 2025
    by Michael Strohmann and Chris Veigl
 
-    This Arduino sketch measures up to 10 Piezo- or FSR-sensors connected to the
-    Analog Input ports of the Controller. Activity triggers are calculated, so that
+    This Arduino sketch measures Piezo- or FSR-sensors connected to the Analog Input ports
+    of the Controller (up to 10 directly, or up to 64 via analog multiplexers, see MUX_SCANNING). Activity triggers are calculated, so that
     a stronger impact creates a longer on-phase of the trigger value. 
-    Trigger values are stored in two bytes (a bit representing a button on/off state) 
-    and sent via Serial1 to the Teensy4.1 microcontroller for controlling Leds and Midi
-    The byte for the trigger1-group is identified by the MSB being 0, whereas the
-    byte for trigger2-group has the MSB set.
+    The filter and trigger logic is in sensordsp.h (also used by the host replay tool, tools/replay):
+    fixed-point biquad banks (no float operations, the Teensy3.2 has no FPU), adaptive
+    per-channel thresholds with calibration after startup, and a fast onset path on the
+    slope of the raw signal (its lead over the lowpass detector is shown with SHOW_LINK_STATS).
+    Sampling is driven by a hardware timer (IntervalTimer): sampleISR() scans all channels
+    SENSOR_OVERSAMPLING times per scan period, sums the samples (integrate and dump decimator,
+    a first order CIC) and keeps the peak of each channel, so short piezo transients are not
+    missed. The decimated scans (mean and peak at SAMPLE_RATE) are written into a small scan buffer,
+    loop() filters the complete scans and uses the remaining time for the link protocol.
+    The envelope streaming and the hit features use the peaks, so the amplitude of short impacts is preserved.
+    With MUX_SCANNING, the sensors are connected to MUX_INPUTS multiplexers (e.g. CD74HC4067)
+    with shared select lines, channel = mux * MUX_ADDRESSES + address. Each timer tick converts
+    the current address on all multiplexers and then already switches the select lines to the
+    next address, so the multiplexers settle during the time until the next tick (pipelined).
+    SHOW_LINK_STATS reports the ISR load per scan and the minimum settling time.
+    Trigger values are stored in a bitset of 32 bit words (a bit representing a button on/off state per channel),
+    changes are found with one XOR per word and only changed words are updated in the STATES payload,
+    so the reporting cost does not grow with the number of channels. The states are sent via Serial1 to the Teensy4.1 microcontroller for controlling Leds and Midi,
+    using the framed protocol defined in sensorlink.h (sync byte, sequence number and CRC-8).
+    Changes are sent as soon as they are detected (rate limited to SENSOR_LINK_MIN_FRAME_INTERVAL),
+    onsets are additionally reported with a velocity in a HITS frame, and the full state
+    is repeated in a KEYFRAME every SLINK_KEYFRAME_PERIOD.
+    After startup the link is switched from SLINK_DEFAULT_BAUD to SENSOR_LINK_BAUD.
+    For expressive control, the impact envelope of active channels is streamed in ENVELOPE
+    frames (peak per envelope period, delta-encoded, SENSOR_ENVELOPE_BATCH samples per frame).
+    Per-channel health statistics (noise, baseline, saturation, trigger rate, see sensorhealth.h)
+    are sent as telemetry records every HEALTH_PERIOD, channels firing at implausible rates
+    (e.g. a broken piezo cable) are muted automatically and re-checked later.
+    When the features of a hit are complete (peak, rise time and energy, see sensordsp.h),
+    they are sent once in a FEATURES frame.
+    Debug traces are sent as binary telemetry records via USB Serial (see telemetry.h),
+    use tools/telemetry_decode.py --plotter to display them. With CAPTURE_RAW_SAMPLES the raw
+    ADC values of every scan are sent instead, for recording traces that can be replayed
+    offline with tools/replay.
+    Crosstalk between neighbouring pads is compensated with learned coefficients (see sensordsp.h),
+    single character commands on USB Serial control the calibration:
+      x   start / stop learning (hit the pads one at a time), the result is stored in the EEPROM
+      c   clear the coefficients
+      p   print the coefficients
+    The detector profile matches the physical sensors (see sensordsp.h), selected with:
+      F   FSR: high minimum threshold, footstep classifier rejects slow weight shifts
+      P   piezo: low minimum threshold, no classifier
+    The selected profile is stored in the EEPROM.
+    The lowpass filters can be retuned live (preset cutoffs of biquadpresets.h, the coefficients are
+    swapped between two scans), trading sensitivity against latency:
+      s / S   lower / raise the cutoff of the trigger signal lowpass
+      b / B   lower / raise the cutoff of the baseline lowpass
     
 */
 
 #include <math.h>
+#include <EEPROM.h>
+#include "sensorlink.h"
+#include "telemetry.h"
+#include "sensordsp.h"
+#include "sensorhealth.h"
 
-#define SHOW_CHANNEL_TRACES 1     // if 1: show filtered baseline and signal traces in serial plotter (for testing)
-#define SHOW_TRIGGER_SIGNALS 0    // if 1: display signal traces in serial plotter (for testing)
+#define SHOW_CHANNEL_TRACES 1     // if 1: send signal, baseline and trigger traces as telemetry records (for testing)
+#define CAPTURE_RAW_SAMPLES 0     // if 1: send the raw ADC values of every scan as telemetry records (disable traces!)
 #define NUMBER_OF_PLAYERS 5
-#define SAMPLING_PERIOD 1          // delay for sampling loop (in milliseconds)
-#define REPORTING_PERIOD 10        // send updates to Teensy4.1 and Terminal every 10 ms
+#define PADS_PER_PLAYER 2
+#define SAMPLE_RATE 1000           // scans of all channels per second (timer driven, up to several kHz)
+#define SCAN_BUFFER_SIZE 8         // scans buffered between the sampling timer and loop(), power of two
+#define SENSOR_OVERSAMPLING 8      // ADC scans per scan period, decimated to SAMPLE_RATE (1 = no oversampling)
+#define ADC_AVERAGING 1            // hardware averaging per conversion (analogReadAveraging, costs conversion time)
+#define ADC_CONVERSION_TIME 4      // approximate duration of one analogRead in microseconds (for the scan budget)
 
-#define TRIGGER_SIGNAL_LOWPASS_CUTOFF   35.0f   // cutoff frequency for trigger signal
-#define BASELINE_SIGNAL_LOWPASS_CUTOFF   0.8f   // cutoff frequency for baseline signal
+#define MUX_SCANNING 0             // if 1: sensors are connected via analog multiplexers
+#define MUX_INPUTS 4               // number of multiplexers, outputs connected to A0, A1, ...
+#define MUX_ADDRESS_BITS 4         // select lines per multiplexer (4 = 16 channels, e.g. CD74HC4067)
+#define MUX_SELECT_PINS {2, 3, 4, 5}   // digital pins driving the select lines (LSB first), shared by all multiplexers
+#define MUX_SETTLE_TIME 2          // settling time after switching the select lines (in microseconds)
+#define REPORTING_PERIOD 10        // send channel traces every 10 ms
+#define SHOW_LINK_STATS 0          // if 1: print link throughput and latency counters every second
 
-#define SENSOR_THRESHOLD_PIEZO 8
-#define SENSOR_THRESHOLD_FSR 100
+#define SENSOR_LINK_BAUD 2000000            // baud rate requested for the link to the Teensy4.1
+#define SENSOR_LINK_MIN_FRAME_INTERVAL 500  // minimum time between two STATES frames (in microseconds)
 
-#define SENSOR_THRESHOLD SENSOR_THRESHOLD_FSR   // use appropirate threshold for physical sensor (piezo or FSR)
+#define SENSOR_ENVELOPE_STREAMING 1     // if 1: stream the envelope of active channels to the Teensy4.1
+#define SENSOR_ENVELOPE_RATE 250        // envelope samples per second and channel
+#define SENSOR_ENVELOPE_BATCH 4         // envelope samples per channel in one ENVELOPE frame
+#define SENSOR_ENVELOPE_SHIFT 2         // sensor value is divided by 2^SHIFT to fit into 8 bits
 
-#define SENSOR_IMPACT_VAL 20
-#define SENSOR_TRIGGER_MAXVALUE 1000
-#define SENSOR_DECAY 10
+// filter and trigger parameters: see sensordsp.h
 
-// IIR lowpass filter parameters
+#define SENSOR_MIN_VELOCITY 40      // MIDI velocity reported for the weakest detected impact
 
-#define FS  1000.0f  // Sampling rate (Hz)
+#define CROSSTALK_EEPROM_ADDRESS 0  // learned crosstalk coefficients are stored here
+#define CROSSTALK_MAGIC 0x5854
+#define PROFILE_MAGIC 0x5046
 
+#define FS  ((float)SAMPLE_RATE)  // Sampling rate (Hz)
+
+#define NUMBER_OF_CHANNELS (NUMBER_OF_PLAYERS * PADS_PER_PLAYER)
+#define TRIGGER_WORDS ((NUMBER_OF_CHANNELS + 31) / 32)   // 32 bit words of a channel bitset
+
+#if MUX_SCANNING
+  #define MUX_ADDRESSES (1 << MUX_ADDRESS_BITS)
+  #define ADC_INPUTS MUX_INPUTS
+  const uint8_t muxSelectPins[MUX_ADDRESS_BITS] = MUX_SELECT_PINS;
+#else
+  #define MUX_ADDRESSES 1
+  #define ADC_INPUTS NUMBER_OF_CHANNELS
+#endif
+#define TICK_RATE (SAMPLE_RATE * SENSOR_OVERSAMPLING * MUX_ADDRESSES)   // sampleISR() calls per second
+
+// scan budget: every tick converts ADC_INPUTS channels, the rest of the tick period is left for settling and loop()
+#if NUMBER_OF_CHANNELS > SENSORDSP_MAX_CHANNELS || NUMBER_OF_CHANNELS > ADC_INPUTS * MUX_ADDRESSES
+  #error "too many channels, increase MUX_INPUTS or MUX_ADDRESS_BITS"
+#endif
+#if ADC_INPUTS * ADC_CONVERSION_TIME * ADC_AVERAGING + MUX_SETTLE_TIME > 1000000 / TICK_RATE * 3 / 4
+  #error "scan does not fit into the tick period, reduce SENSOR_OVERSAMPLING or SAMPLE_RATE"
+#endif
+
+SensorDsp dsp;                            // filter and trigger state of all channels (see sensordsp.h)
+SensorHealth health;                      // per-channel diagnostics (see sensorhealth.h)
+int raw[NUMBER_OF_CHANNELS], peak[NUMBER_OF_CHANNELS];
+
+// layout of the crosstalk coefficients in the EEPROM
 typedef struct {
-    // coefficients
-    float b0, b1, b2;
-    float a1, a2;
-    // state
-    float xv1, xv2;  // x[n-1], x[n-2]
-    float yv1, yv2;  // y[n-1], y[n-2]
-} IIRLowPassState;
-
-// Initialize a filter instance
-//   f    = cutoff freq in Hz (e.g. 20.0f)
-//   Q    = quality factor (e.g. 0.707f for Butterworth)
-//   st   = pointer to your filter instance
-static inline void iir_lowpass2_init(IIRLowPassState *st, float f, float Q) {
-    float w0    = 2.0f * M_PI * (f / FS);
-    float alpha = sinf(w0) / (2.0f * Q);
-
-    float b0n =  (1.0f - cosf(w0)) / 2.0f;
-    float b1n =   1.0f - cosf(w0);
-    float b2n =  (1.0f - cosf(w0)) / 2.0f;
-    float a0n =   1.0f + alpha;
-    float a1n =  -2.0f * cosf(w0);
-    float a2n =   1.0f - alpha;
-    st->b0 = b0n / a0n;
-    st->b1 = b1n / a0n;
-    st->b2 = b2n / a0n;
-    st->a1 = a1n / a0n;
-    st->a2 = a2n / a0n;
-    st->xv1 = st->xv2 = 0.0f;
-    st->yv1 = st->yv2 = 0.0f;
-}
-
-// Returns the filtered sample (int).
-static inline int iir_lowpass2_process(IIRLowPassState *st, int x) {
-    float xn = (float)x;
-    // standard biquad difference equation:
-    float yn = st->b0 * xn
-             + st->b1 * st->xv1
-             + st->b2 * st->xv2
-             - st->a1 * st->yv1
-             - st->a2 * st->yv2;
-
-    // shift delay‐lines
-    st->xv2 = st->xv1;
-    st->xv1 = xn;
-    st->yv2 = st->yv1;
-    st->yv1 = yn;
-    return (int)yn;
-}
-
-IIRLowPassState filterState[NUMBER_OF_PLAYERS * 4];   // 2 triggers per player, 2 signals per trigger
-
-int triggers[NUMBER_OF_PLAYERS * 2]={0};
-uint8_t trigger1Group=0, lastTrigger1Group=0;
-uint8_t trigger2Group=0x80, lastTrigger2Group=0x80;
+  uint16_t magic;
+  uint8_t channels, span;
+  int16_t crosstalk[NUMBER_OF_CHANNELS][SENSORDSP_NEIGHBOURS];
+  uint8_t checksum;
+} StoredCrosstalk;
 
-void setup() {
-  Serial.begin(115200);
-  Serial1.begin(115200);
-  for(int i = 0; i < NUMBER_OF_PLAYERS*2; i++) {
-    iir_lowpass2_init(&filterState[i*2], TRIGGER_SIGNAL_LOWPASS_CUTOFF, 0.707f);
-    iir_lowpass2_init(&filterState[i*2+1], BASELINE_SIGNAL_LOWPASS_CUTOFF, 0.707f);
+// the detector profile is stored behind the crosstalk coefficients
+typedef struct {
+  uint16_t magic;
+  uint8_t profile;
+} StoredProfile;
+#define PROFILE_EEPROM_ADDRESS (CROSSTALK_EEPROM_ADDRESS + sizeof(StoredCrosstalk))
+
+IntervalTimer samplingTimer;
+volatile uint16_t scanBuffer[SCAN_BUFFER_SIZE][NUMBER_OF_CHANNELS];   // decimated ADC values (mean), written by sampleISR()
+volatile uint16_t scanPeak[SCAN_BUFFER_SIZE][NUMBER_OF_CHANNELS];     // maximum ADC value within each scan period
+uint32_t oversampleSum[NUMBER_OF_CHANNELS];             // decimator state (sampleISR() only)
+uint16_t oversamplePeak[NUMBER_OF_CHANNELS];
+uint8_t oversampleCount=0;
+uint32_t oversampleStart=0;
+volatile uint32_t scanTime[SCAN_BUFFER_SIZE];                         // micros() at the start of each scan
+volatile uint8_t scanHead=0;                                          // next scan written by sampleISR()
+uint8_t scanTail=0;                                                   // next scan processed by loop()
+volatile uint32_t scanOverruns=0, scanDurationMax=0;                 // scanDurationMax: longest sampleISR() call
+volatile uint32_t scanBusyMax=0;                                      // longest sum of sampleISR() durations per scan
+uint32_t scanBusy=0;
+uint8_t muxAddress=0;                                                 // address currently selected (sampleISR() only)
+uint32_t scansProcessed=0, heartbeatScans=0;
+
+uint32_t lastTriggerBits[TRIGGER_WORDS]={0};   // trigger states of the last STATES frame
+uint8_t statesPayload[SLINK_MAX_PAYLOAD];     // bitset part of the STATES payload, updated for changed words only
+int statesLen=0;
+uint32_t changeTimestamp=0;               // micros() of the oldest trigger change not sent yet
+uint8_t changePending=0;
+
+uint8_t txSeq=0;                          // sequence number for frames sent to the Teensy4.1
+uint8_t txFrame[SLINK_MAX_FRAME];
+SlinkParser rxParser;                     // parser for frames received from the Teensy4.1
+uint32_t linkBaud=SLINK_DEFAULT_BAUD;
+uint8_t linkNegotiated=0;
+uint32_t lastAckTime=0, lastRequestTime=0, lastKeyframeTime=0, lastHeartbeatTime=0, lastStatesTime=0;
+
+// flow accounting (reset every second when SHOW_LINK_STATS is enabled)
+uint32_t framesSent=0, bytesSent=0, rateLimited=0, maxAge=0, envelopesTruncated=0;
+
+#define ENVELOPE_DECIMATION ((int)(FS / SENSOR_ENVELOPE_RATE))   // samples per envelope period
+#define ENVELOPE_FRAME_SIZE (SLINK_HEADER_SIZE + 2 + NUMBER_OF_CHANNELS * (1 + SENSOR_ENVELOPE_BATCH))
+#if ENVELOPE_FRAME_SIZE > SLINK_MAX_FRAME   // more active channels than fit into one frame are truncated (envelopesTruncated)
+  #undef ENVELOPE_FRAME_SIZE
+  #define ENVELOPE_FRAME_SIZE SLINK_MAX_FRAME
+#endif
+
+// bandwidth budget: envelope frames with all channels active may use at most half of the default link
+#if SENSOR_ENVELOPE_STREAMING && (ENVELOPE_FRAME_SIZE * 10 * SENSOR_ENVELOPE_RATE / SENSOR_ENVELOPE_BATCH > SLINK_DEFAULT_BAUD / 2)
+  #error "envelope streaming exceeds the bandwidth budget, reduce SENSOR_ENVELOPE_RATE or increase SENSOR_ENVELOPE_BATCH"
+#endif
+
+TelemetryBuffer telemetry;                // debug records, flushed to USB Serial when there is room
+
+uint8_t envelopePeak[NUMBER_OF_CHANNELS]={0};                         // peak within the current envelope period
+uint8_t envelopeBatch[NUMBER_OF_CHANNELS][SENSOR_ENVELOPE_BATCH];     // envelope samples waiting to be sent
+uint32_t envelopeActive[TRIGGER_WORDS]={0};                           // channels active during the current batch
+int envelopeCount=0, envelopeDecimation=0;
+
+void sendFrame(uint8_t type, const uint8_t *payload, int len) {
+  int n = slink_encode(txFrame, txSeq, type, payload, len);
+  if (n) {
+    Serial1.write(txFrame, n);
+    txSeq++;
+    framesSent++;
+    bytesSent+=n;
   }
 }
 
-void loop() {
- 
-  static uint32_t reportingTimestamp=0;
-  static int fps=0;
-  int reportNow=0;
-  uint8_t * actTriggerGroup=0;
-
-  uint32_t now=millis();
-  if (now-reportingTimestamp>REPORTING_PERIOD) {
-    reportNow=1;
-    reportingTimestamp=now;
-  }
-  
-  for (int i=0; i < NUMBER_OF_PLAYERS * 2; i++) {
-    int raw=analogRead(A0+i);
-    int signal=iir_lowpass2_process(&filterState[i*2],raw);      //  20 Hz LP
-    int baseline=iir_lowpass2_process(&filterState[i*2+1],raw);  // 0.5 Hz LP
-    int sensorVal=signal-baseline;
-
-    if (SHOW_CHANNEL_TRACES && reportNow)  Serial.printf("%d,%d,",signal, baseline);
-    
-    if (i%2) actTriggerGroup = &trigger2Group; else actTriggerGroup = &trigger1Group;
-    
-    if ((sensorVal > SENSOR_THRESHOLD) && (triggers[i] < SENSOR_TRIGGER_MAXVALUE))
-      triggers[i] += SENSOR_IMPACT_VAL;
-  
-    if (triggers[i] > SENSOR_DECAY) {
-      triggers[i] -= SENSOR_DECAY;
-      *actTriggerGroup |= (1<<(i>>1));
+void sendStates(uint8_t type, uint16_t age, uint32_t timestamp) {
+  uint8_t payload[SLINK_MAX_PAYLOAD];
+  memcpy(payload, statesPayload, statesLen);
+  int len = slink_put_u16(payload, statesLen, age);
+  len = slink_put_u32(payload, len, timestamp);
+  sendFrame(type, payload, len);
+}
+
+// send trigger states and new onsets (with velocity) to the Teensy4.1 as soon as they change
+void reportTriggers(uint32_t sampleTime) {
+  uint8_t payload[SLINK_MAX_PAYLOAD];
+  uint32_t changed=0;
+  int len=0;
+
+  for (int w=0; w < TRIGGER_WORDS; w++) changed |= dsp.triggerBits[w] ^ lastTriggerBits[w];
+  if (!changed) return;
+
+  uint32_t nowMicros=micros();
+  if (!changePending) {
+    changePending=1;
+    changeTimestamp=sampleTime;   // age includes the time the scan waited in the buffer
+  }
+  if (nowMicros-lastStatesTime < SENSOR_LINK_MIN_FRAME_INTERVAL) {   // rate limit: send with a later sample
+    rateLimited++;
+    return;
+  }
+
+  for (int w=0; w < TRIGGER_WORDS; w++) {
+    uint32_t diff = dsp.triggerBits[w] ^ lastTriggerBits[w];
+    if (!diff) continue;   // only changed words are touched
+    for (uint32_t onsets = diff & dsp.triggerBits[w]; onsets; onsets &= onsets-1) {
+      int i = w*32 + __builtin_ctz(onsets);
+      int velocity = map(dsp.triggers[i], 0, SENSOR_TRIGGER_MAXVALUE, SENSOR_MIN_VELOCITY, 127);
+      len = slink_add_hit(payload, len, i, constrain(velocity, 1, 127), SLINK_POSITION_UNKNOWN);
     }
-    else {
-      triggers[i]=0;
-      *actTriggerGroup &= ~(1<<(i>>1));
+    slink_states_put_word(statesPayload, w, dsp.triggerBits[w]);
+    lastTriggerBits[w] = dsp.triggerBits[w];
+  }
+  if (len) sendFrame(SLINK_TYPE_HITS, payload, len);
+
+  uint32_t age = nowMicros-changeTimestamp;
+  if (age > maxAge) maxAge=age;
+  sendStates(SLINK_TYPE_STATES, age < SLINK_AGE_UNKNOWN ? age : SLINK_AGE_UNKNOWN-1, changeTimestamp);
+  lastStatesTime=nowMicros;
+  changePending=0;
+}
+
+// send the features of the completed hits (once per onset)
+void reportHitFeatures() {
+  uint8_t payload[SLINK_MAX_PAYLOAD];
+  int len=0;
+  for (int w=0; w < TRIGGER_WORDS; w++) {
+    for (uint32_t ready = dsp.hitReady[w]; ready; ready &= ready-1) {
+      int i = w*32 + __builtin_ctz(ready);
+      if (len + SLINK_FEATURES_SIZE > SLINK_MAX_PAYLOAD) {   // frame full: send and continue with the next one
+        sendFrame(SLINK_TYPE_FEATURES, payload, len);
+        len=0;
+      }
+      uint32_t rise = (uint32_t)dsp.hitRise[i] * 1000000UL / SAMPLE_RATE;
+      len = slink_add_features(payload, len, i, dsp.hitPeak[i] < 0xFFFF ? dsp.hitPeak[i] : 0xFFFF,
+                               rise < 0xFFFF ? rise : 0xFFFF, dsp.hitEnergy[i] < 0xFFFF ? dsp.hitEnergy[i] : 0xFFFF);
+    }
+    dsp.hitReady[w]=0;
+  }
+  if (len) sendFrame(SLINK_TYPE_FEATURES, payload, len);
+}
+
+// report the health statistics of all channels, announce changes of the channel status
+void reportHealth(uint32_t scanTime) {
+  static uint8_t lastStatus[NUMBER_OF_CHANNELS]={0};
+  health_evaluate(&health, &dsp);
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++) {
+    uint8_t status = health.status[i];
+    uint8_t id = i | (status & HEALTH_MUTED ? 0x80 : 0) | (status & HEALTH_SILENT ? 0x40 : 0);
+    tlm_record(&telemetry, TLM_CHANNEL_HEALTH, id, scanTime, health.noiseRms[i] < 0x7FFF ? health.noiseRms[i] : 0x7FFF,
+               dsp.baseline[i], health.lastSaturated[i], health.lastOnsets[i]);
+    if (status == lastStatus[i]) continue;
+    if ((status & HEALTH_MUTED) && !(lastStatus[i] & HEALTH_MUTED))
+      Serial.printf("channel %d muted: %d onsets per period\n", i, health.lastOnsets[i]);
+    if (!(status & HEALTH_MUTED) && (lastStatus[i] & HEALTH_MUTED))
+      Serial.printf("channel %d enabled again\n", i);
+    if (status & HEALTH_SILENT & ~lastStatus[i])
+      Serial.printf("channel %d silent: check the sensor cable\n", i);
+    lastStatus[i] = status;
+  }
+}
+
+// collect the envelope of one channel (called for every scan with the peak of the scan period)
+static inline void trackEnvelope(int i, int peak) {
+  int value = peak >> SENSOR_ENVELOPE_SHIFT;
+  if (value > 255) value = 255;
+  if (value > envelopePeak[i]) envelopePeak[i] = value;
+}
+
+// store the envelope peaks at SENSOR_ENVELOPE_RATE and send a frame when a batch is complete
+void reportEnvelopes() {
+  if (++envelopeDecimation < ENVELOPE_DECIMATION) return;
+  envelopeDecimation=0;
+
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++) {
+    envelopeBatch[i][envelopeCount] = envelopePeak[i];
+    envelopePeak[i] = 0;
+  }
+  if (++envelopeCount < SENSOR_ENVELOPE_BATCH) return;
+  envelopeCount=0;
+
+  uint8_t payload[SLINK_MAX_PAYLOAD];
+  int len=1;
+  payload[0]=SENSOR_ENVELOPE_BATCH;
+  for (int w=0; w < TRIGGER_WORDS; w++) {
+    for (uint32_t active = envelopeActive[w]; active; active &= active-1) {   // only active channels are streamed
+      int i = w*32 + __builtin_ctz(active);
+      int newLen = slink_add_envelope(payload, len, i, envelopeBatch[i], SENSOR_ENVELOPE_BATCH);
+      if (newLen == len) envelopesTruncated++;
+      len = newLen;
+    }
+    envelopeActive[w]=0;
+  }
+  if (len > 1) sendFrame(SLINK_TYPE_ENVELOPE, payload, len);
+}
+
+// write pending telemetry records without blocking the sampling loop
+void flushTelemetry() {
+  const uint8_t *data;
+  int n = tlm_flush_chunk(&telemetry, &data, Serial.availableForWrite());
+  if (n > 0) {
+    Serial.write(data, n);
+    tlm_consume(&telemetry, n);
+  }
+}
+
+void setLinkBaud(uint32_t baud) {
+  if (baud == linkBaud) return;
+  Serial1.flush();
+  Serial1.begin(baud);
+  linkBaud=baud;
+  rxParser.state=SLINK_WAIT_SYNC;
+}
+
+// answer a clock sync PING: echo the Teensy timestamp and add our reception time
+void sendPong(uint32_t receiveTime) {
+  uint8_t payload[8];
+  int len = slink_put_u32(payload, 0, slink_get_u32(rxParser.payload));
+  len = slink_put_u32(payload, len, receiveTime);
+  sendFrame(SLINK_TYPE_PONG, payload, len);
+}
+
+uint8_t crosstalkChecksum(const StoredCrosstalk *stored) {
+  const uint8_t *data = (const uint8_t *) stored->crosstalk;
+  uint8_t sum=0;
+  for (unsigned int i=0; i < sizeof(stored->crosstalk); i++) sum = (sum << 1 | sum >> 7) ^ data[i];
+  return sum;
+}
+
+void loadCrosstalk() {
+  StoredCrosstalk stored;
+  EEPROM.get(CROSSTALK_EEPROM_ADDRESS, stored);
+  if (stored.magic != CROSSTALK_MAGIC || stored.channels != NUMBER_OF_CHANNELS ||
+      stored.span != SENSOR_CROSSTALK_SPAN || stored.checksum != crosstalkChecksum(&stored)) return;
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++)
+    for (int k=0; k < SENSORDSP_NEIGHBOURS; k++) dsp.crosstalk[i][k]=stored.crosstalk[i][k];
+}
+
+void saveCrosstalk() {
+  StoredCrosstalk stored;
+  stored.magic=CROSSTALK_MAGIC;
+  stored.channels=NUMBER_OF_CHANNELS;
+  stored.span=SENSOR_CROSSTALK_SPAN;
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++)
+    for (int k=0; k < SENSORDSP_NEIGHBOURS; k++) stored.crosstalk[i][k]=dsp.crosstalk[i][k];
+  stored.checksum=crosstalkChecksum(&stored);
+  EEPROM.put(CROSSTALK_EEPROM_ADDRESS, stored);
+}
+
+// one line per channel: crosstalk of the neighbours i-SPAN .. i+SPAN in percent
+void printCrosstalk() {
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++) {
+    Serial.printf("channel %d:", i);
+    for (int k=0; k < SENSORDSP_NEIGHBOURS; k++) {
+      if (k == SENSOR_CROSSTALK_SPAN) Serial.printf("     -");
+      Serial.printf(" %5.1f", dsp.crosstalk[i][k] * 100.0f / (1 << SENSORDSP_CROSSTALK_SHIFT));
     }
+    Serial.printf("\n");
+  }
+}
 
-    if (reportNow && SHOW_TRIGGER_SIGNALS) {
-      Serial.print(triggers[i]); Serial.print(",");
+void loadProfile() {
+  StoredProfile stored;
+  EEPROM.get(PROFILE_EEPROM_ADDRESS, stored);
+  if (stored.magic != PROFILE_MAGIC || stored.profile > SENSORDSP_PROFILE_FSR) return;
+  sensordsp_set_profile(&dsp, stored.profile);
+}
+
+void selectProfile(int profile) {
+  StoredProfile stored;
+  sensordsp_set_profile(&dsp, profile);
+  stored.magic=PROFILE_MAGIC;
+  stored.profile=profile;
+  EEPROM.put(PROFILE_EEPROM_ADDRESS, stored);
+  Serial.printf("%s profile: minimum threshold %d, classifier %s\n", profile == SENSORDSP_PROFILE_FSR ? "FSR" : "piezo",
+                dsp.minThreshold, dsp.classifier ? "on" : "off");
+}
+
+// step the cutoff of a lowpass to the next lower (direction -1) or higher preset
+void stepCutoff(int filter, int direction) {
+  const float *presets = filter == SENSORDSP_SIGNAL_FILTER ? biquadSignalCutoffs : biquadBaselineCutoffs;
+  int count = filter == SENSORDSP_SIGNAL_FILTER ? BIQUAD_SIGNAL_PRESETS : BIQUAD_BASELINE_PRESETS;
+  float current = dsp.cutoff[filter], cutoff = current;
+  for (int i=0; i < count; i++) {
+    if (direction > 0 && presets[i] > current + 0.01f) { cutoff = presets[i]; break; }
+    if (direction < 0 && presets[i] < current - 0.01f) cutoff = presets[i];
+  }
+  sensordsp_retune(&dsp, filter, cutoff);
+  Serial.printf("%s lowpass: %.1f Hz\n", filter == SENSORDSP_SIGNAL_FILTER ? "signal" : "baseline", cutoff);
+}
+
+// single character commands on USB Serial
+void handleCommands() {
+  while (Serial.available()) {
+    int command = Serial.read();
+    if (!SENSOR_CROSSTALK && (command == 'x' || command == 'c' || command == 'p')) continue;
+    switch (command) {
+      case 'F':
+        selectProfile(SENSORDSP_PROFILE_FSR);
+        break;
+      case 'P':
+        selectProfile(SENSORDSP_PROFILE_PIEZO);
+        break;
+      case 's':
+      case 'S':
+        stepCutoff(SENSORDSP_SIGNAL_FILTER, command == 'S' ? 1 : -1);
+        break;
+      case 'b':
+      case 'B':
+        stepCutoff(SENSORDSP_BASELINE_FILTER, command == 'B' ? 1 : -1);
+        break;
+      case 'x':
+        if (!dsp.crosstalkCalibrating) {
+          sensordsp_crosstalk_begin(&dsp);
+          Serial.printf("crosstalk calibration: hit the pads one at a time, x to finish\n");
+        }
+        else {
+          Serial.printf("%d crosstalk coefficients learned\n", sensordsp_crosstalk_end(&dsp));
+          saveCrosstalk();
+          printCrosstalk();
+        }
+        break;
+      case 'c':
+        memset(dsp.crosstalk, 0, sizeof(dsp.crosstalk));
+        saveCrosstalk();
+        Serial.printf("crosstalk coefficients cleared\n");
+        break;
+      case 'p':
+        printCrosstalk();
+        break;
     }
   }
-  
-  if (reportNow) { 
-    if (SHOW_TRIGGER_SIGNALS || SHOW_CHANNEL_TRACES )  { 
-      // Serial.print(fps); fps=0;
-      Serial.println("");  // newline, needed by Serial Plotter
+}
+
+// median and maximum lead of the fast onset path over the lowpass detector
+void printOnsetLead() {
+  int median, maximum;
+  uint32_t total = sensordsp_lead_stats(&dsp, &median, &maximum);
+  Serial.printf("onsets=%lu, fast onset lead median=%dus max=%dus, rejected=%lu\n", total,
+                median*1000000/SAMPLE_RATE, maximum*1000000/SAMPLE_RATE, dsp.fastRejected);
+}
+
+// negotiate the link mode, send keyframes and handle frames from the Teensy4.1
+void updateLink(uint32_t now) {
+  while (Serial1.available()) {
+    uint32_t receiveTime=micros();   // a PING waits at most for the processing of the pending scans
+    if (!slink_parser_feed(&rxParser, Serial1.read()) || rxParser.len < 4) continue;
+    if (rxParser.type == SLINK_TYPE_LINK_ACK) {
+      if (!slink_baud_valid(slink_get_u32(rxParser.payload), SENSOR_LINK_BAUD)) continue;   // keep the current rate
+      lastAckTime=now;
+      linkNegotiated=1;
+      setLinkBaud(slink_get_u32(rxParser.payload));
     }
+    else if (rxParser.type == SLINK_TYPE_PING) sendPong(receiveTime);
+  }
+
+  if (!linkNegotiated && now-lastRequestTime >= SLINK_REQUEST_PERIOD) {
+    uint8_t payload[4];
+    sendFrame(SLINK_TYPE_LINK_REQUEST, payload, slink_put_u32(payload, 0, SENSOR_LINK_BAUD));
+    lastRequestTime=now;
+  }
+
+  if (now-lastHeartbeatTime >= SLINK_HEARTBEAT_PERIOD && scansProcessed != heartbeatScans) {   // tells the Teensy4.1 that sampling is alive
+    uint8_t payload[4];
+    int len = slink_put_u16(payload, 0, rxParser.crcErrors);
+    len = slink_put_u16(payload, len, rxParser.lostFrames);
+    sendFrame(SLINK_TYPE_HEARTBEAT, payload, len);
+    lastHeartbeatTime=now;
+    heartbeatScans=scansProcessed;
+  }
+
+  if (now-lastKeyframeTime >= SLINK_KEYFRAME_PERIOD) {
+    sendStates(SLINK_TYPE_KEYFRAME, SLINK_AGE_UNKNOWN, micros());
+    lastKeyframeTime=now;
+  }
 
-    // send changes to Teensy4.1
-    if (lastTrigger1Group!=trigger1Group) {
-       Serial1.write(trigger1Group);
-       lastTrigger1Group=trigger1Group;
+  if (linkNegotiated && now-lastAckTime > SLINK_LINK_TIMEOUT) {
+    setLinkBaud(SLINK_DEFAULT_BAUD);   // Teensy4.1 does not answer: fall back and negotiate again
+    linkNegotiated=0;
+  }
+
+  if (SHOW_LINK_STATS) {
+    static uint32_t statsTime=0;
+    if (now-statsTime >= 1000) {
+      Serial.printf("baud=%lu frames/s=%lu bytes/s=%lu rateLimited=%lu maxAge=%luus envelopesTruncated=%lu telemetryDropped=%lu\n",
+                    linkBaud, framesSent, bytesSent, rateLimited, maxAge, envelopesTruncated, telemetry.dropped);
+      Serial.printf("scan busy max=%luus of %dus (%lu%%), tick max=%luus, settle min=%ldus, scan overruns=%lu\n",
+                    scanBusyMax, 1000000 / SAMPLE_RATE, scanBusyMax * SAMPLE_RATE / 10000, scanDurationMax,
+                    (long)(1000000 / TICK_RATE) - (long)scanDurationMax, scanOverruns);
+      if (SENSOR_FAST_ONSET) printOnsetLead();
+      if (dsp.classifier) Serial.printf("slow loading rejected=%lu\n", dsp.slowRejected);
+      framesSent=bytesSent=rateLimited=maxAge=envelopesTruncated=0;
+      scanDurationMax=scanBusyMax=scanOverruns=0;
+      statsTime=now;
     }
-    if (lastTrigger2Group!=trigger2Group) {
-       Serial1.write(trigger2Group);
-       lastTrigger2Group=trigger2Group;
+  }
+}
+
+#if MUX_SCANNING
+void selectMuxAddress(uint8_t address) {
+  for (int b=0; b < MUX_ADDRESS_BITS; b++) digitalWriteFast(muxSelectPins[b], (address >> b) & 1);
+}
+#endif
+
+// timer interrupt at TICK_RATE: convert the selected address of all ADC inputs, store decimated scans in the scan buffer
+void sampleISR() {
+  uint32_t start=micros();
+  if (oversampleCount == 0 && muxAddress == 0) oversampleStart=start;
+  for (int k=0, i=muxAddress; k < ADC_INPUTS; k++, i+=MUX_ADDRESSES) {
+    if (i >= NUMBER_OF_CHANNELS) break;
+    uint16_t value=analogRead(A0+k);
+    oversampleSum[i]+=value;
+    if (value > oversamplePeak[i]) oversamplePeak[i]=value;
+  }
+#if MUX_SCANNING
+  muxAddress=(muxAddress+1) & (MUX_ADDRESSES-1);
+  selectMuxAddress(muxAddress);   // settles until the next tick
+#endif
+
+  if (muxAddress == 0 && ++oversampleCount >= SENSOR_OVERSAMPLING) {   // scan period complete: dump the decimator
+    uint8_t head=scanHead;
+    if (((head+1) & (SCAN_BUFFER_SIZE-1)) == scanTail) scanOverruns++;   // loop() did not keep up: drop this scan
+    else {
+      for (int i=0; i < NUMBER_OF_CHANNELS; i++) {
+        scanBuffer[head][i]=(oversampleSum[i] + SENSOR_OVERSAMPLING/2) / SENSOR_OVERSAMPLING;
+        scanPeak[head][i]=oversamplePeak[i];
+      }
+      scanTime[head]=oversampleStart;
+      scanHead=(head+1) & (SCAN_BUFFER_SIZE-1);
+    }
+    for (int i=0; i < NUMBER_OF_CHANNELS; i++) oversampleSum[i]=oversamplePeak[i]=0;
+    oversampleCount=0;
+  }
+  uint32_t duration=micros()-start;
+  if (duration > scanDurationMax) scanDurationMax=duration;
+  scanBusy+=duration;
+  if (muxAddress == 0 && oversampleCount == 0) {
+    if (scanBusy > scanBusyMax) scanBusyMax=scanBusy;
+    scanBusy=0;
+  }
+}
+
+// filter one complete scan and update the triggers
+void processScan(int scan, int reportNow) {
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++) {
+    raw[i]=scanBuffer[scan][i];
+    peak[i]=scanPeak[scan][i];
+  }
+
+  if (CAPTURE_RAW_SAMPLES)
+    for (int i=0; i < NUMBER_OF_CHANNELS; i+=4)
+      tlm_record(&telemetry, TLM_RAW_SCAN, i, scanTime[scan], raw[i], i+1 < NUMBER_OF_CHANNELS ? raw[i+1] : 0,
+                 i+2 < NUMBER_OF_CHANNELS ? raw[i+2] : 0, i+3 < NUMBER_OF_CHANNELS ? raw[i+3] : 0);
+
+  int flags = sensordsp_process(&dsp, raw, peak);
+  if (flags & SENSORDSP_CALIBRATED) {
+    for (int i=0; i < NUMBER_OF_CHANNELS; i++)
+      Serial.printf("channel %d: noise=%ld, threshold=%d\n", i, dsp.noiseLevel[i] >> 12, dsp.onThreshold[i]);
+  }
+
+  if (SENSOR_ENVELOPE_STREAMING)
+    for (int w=0; w < TRIGGER_WORDS; w++) envelopeActive[w] |= dsp.triggerBits[w];
+  for (int i=0; i < NUMBER_OF_CHANNELS; i++) {
+    if (SENSOR_ENVELOPE_STREAMING) trackEnvelope(i, peak[i] - dsp.baseline[i]);   // peak above the baseline
+    if (SHOW_CHANNEL_TRACES && reportNow)
+      tlm_record(&telemetry, TLM_CHANNEL_TRACE, i, scanTime[scan], dsp.signal[i], dsp.baseline[i], dsp.triggers[i], dsp.sensorVal[i]);
+  }
+
+  // send changes to Teensy4.1
+  reportTriggers(scanTime[scan]);
+  if (flags & SENSORDSP_HITS) reportHitFeatures();
+  if (health_update(&health, &dsp)) reportHealth(scanTime[scan]);
+  if (SENSOR_ENVELOPE_STREAMING) reportEnvelopes();
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial1.begin(SLINK_DEFAULT_BAUD);
+  slink_parser_init(&rxParser);
+  tlm_init(&telemetry);
+  statesLen = slink_init_states(statesPayload, NUMBER_OF_CHANNELS);
+  sensordsp_init(&dsp, NUMBER_OF_CHANNELS, SAMPLE_RATE);
+  health_init(&health, NUMBER_OF_CHANNELS, SAMPLE_RATE);
+  if (SENSOR_CROSSTALK) loadCrosstalk();
+  loadProfile();
+  analogReadAveraging(ADC_AVERAGING);
+#if MUX_SCANNING
+  for (int b=0; b < MUX_ADDRESS_BITS; b++) pinMode(muxSelectPins[b], OUTPUT);
+  selectMuxAddress(0);
+  delayMicroseconds(MUX_SETTLE_TIME);
+#endif
+  Serial.printf("scanning %d channels (%d ADC inputs x %d addresses), %d Hz x %d oversampling, tick period %dus\n",
+                NUMBER_OF_CHANNELS, ADC_INPUTS, MUX_ADDRESSES, SAMPLE_RATE, SENSOR_OVERSAMPLING, 1000000 / TICK_RATE);
+  samplingTimer.begin(sampleISR, 1000000.0f / TICK_RATE);
+}
+
+void loop() {
+  static uint32_t reportingTimestamp=0;
+
+  // filtering runs on complete scans, the time in between is free for the link
+  while (scanTail != scanHead) {
+    int reportNow=0;
+    if (scanTime[scanTail]-reportingTimestamp >= REPORTING_PERIOD*1000UL) {
+      reportNow=1;
+      reportingTimestamp=scanTime[scanTail];
     }
+    processScan(scanTail, reportNow);
+    scanTail=(scanTail+1) & (SCAN_BUFFER_SIZE-1);
+    scansProcessed++;
   }
-  fps++;
-  while (millis()-now < SAMPLING_PERIOD);   // try to keep the loop update rate at sampling frequency
+
+  updateLink(millis());
+  handleCommands();
+  flushTelemetry();
 }
 
 /*
@@ -0,0 +1,145 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Fixed-point biquad filter bank: one filter (same coefficients) for all channels,
+    state stored as structure of arrays, so all channels are processed in one loop
+    without float operations.
+
+    Coefficients are Q30 (range -2..2, enough resolution for low cutoff frequencies
+    like the 0.8 Hz baseline filter), samples and filter states are Q14 (ADC value * 16384).
+    The products are accumulated in 64 bit (single cycle SMLAL on Cortex-M4/M7),
+    the rounding error of each output is fed back into the next sample (error feedback),
+    which keeps low cutoff filters free of dead bands and limit cycles.
+    Results are saturated to BIQUAD_STATE_MAX instead of wrapping around.
+    The coefficients can be replaced between two samples (biquad_bank_set_coefs()), the direct
+    form I states are plain input and output samples, so a retuned filter continues without a step.
+*/
+
+#ifndef BIQUADBANK_H
+#define BIQUADBANK_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define BIQUAD_MAX_CHANNELS  64
+#define BIQUAD_COEF_SHIFT    30                  // Q30 coefficients
+#define BIQUAD_SAMPLE_SHIFT  14                  // Q14 samples and states
+#define BIQUAD_STATE_MAX     0x7FFFFFFF          // saturation limit for the Q14 states (about +/-131072 ADC units)
+
+// coefficients (Q30), a0 normalised to 1
+typedef struct {
+    int32_t b0, b1, b2;
+    int32_t a1, a2;
+} BiquadCoefs;
+
+typedef struct {
+    // coefficients (Q30), shared by all channels, a0 normalised to 1
+    int32_t b0, b1, b2;
+    int32_t a1, a2;
+    int n;                                   // number of channels
+    // state per channel (Q14)
+    int32_t x1[BIQUAD_MAX_CHANNELS], x2[BIQUAD_MAX_CHANNELS];   // x[n-1], x[n-2]
+    int32_t y1[BIQUAD_MAX_CHANNELS], y2[BIQUAD_MAX_CHANNELS];   // y[n-1], y[n-2]
+    int32_t err[BIQUAD_MAX_CHANNELS];                           // rounding error of the last output (Q44 remainder)
+} BiquadBank;
+
+// the coefficients are computed in double: a float resolves a1 (about -2) only to 256 Q30 units, which
+// shifts the poles and the DC gain of low cutoffs by several percent (e.g. 0.8 Hz at 4 kHz)
+static inline int32_t biquad_to_q30(double c) {
+    double scaled = c * (double)(1L << BIQUAD_COEF_SHIFT);
+    if (scaled >= 2147483647.0) return 0x7FFFFFFF;
+    if (scaled <= -2147483648.0) return (int32_t)0x80000000;
+    return (int32_t)lround(scaled);
+}
+
+// Compute the coefficients of a 2nd order lowpass (RBJ cookbook)
+//   f    = cutoff freq in Hz (e.g. 20.0f)
+//   Q    = quality factor (e.g. 0.707f for Butterworth)
+//   fs   = sampling rate in Hz
+static inline void biquad_lowpass_coefs(BiquadCoefs *coefs, float f, float Q, float fs) {
+    double w0    = 2.0 * M_PI * ((double)f / fs);
+    double alpha = sin(w0) / (2.0 * Q);
+    double a0    = 1.0 + alpha;
+    coefs->b0 = biquad_to_q30((1.0 - cos(w0)) / 2.0 / a0);
+    coefs->b1 = biquad_to_q30((1.0 - cos(w0)) / a0);
+    coefs->b2 = coefs->b0;
+    coefs->a1 = biquad_to_q30(-2.0 * cos(w0) / a0);
+    coefs->a2 = biquad_to_q30((1.0 - alpha) / a0);
+}
+
+// Replace the coefficients, call between two biquad_bank_process() calls (the states are kept)
+static inline void biquad_bank_set_coefs(BiquadBank *bank, const BiquadCoefs *coefs) {
+    bank->b0 = coefs->b0;
+    bank->b1 = coefs->b1;
+    bank->b2 = coefs->b2;
+    bank->a1 = coefs->a1;
+    bank->a2 = coefs->a2;
+    for (int i = 0; i < bank->n; i++) bank->err[i] = 0;   // remainder of the old coefficients
+}
+
+// Set the coefficients of a 2nd order lowpass (see biquad_lowpass_coefs())
+static inline void biquad_bank_lowpass(BiquadBank *bank, float f, float Q, float fs) {
+    BiquadCoefs coefs;
+    biquad_lowpass_coefs(&coefs, f, Q, fs);
+    biquad_bank_set_coefs(bank, &coefs);
+}
+
+// Set the coefficients of a 2nd order bandpass, 0 dB peak gain (RBJ cookbook)
+//   f    = center freq in Hz
+//   Q    = quality factor (0.707f: about one octave below to one octave above f)
+//   fs   = sampling rate in Hz
+static inline void biquad_bank_bandpass(BiquadBank *bank, float f, float Q, float fs) {
+    double w0    = 2.0 * M_PI * ((double)f / fs);
+    double alpha = sin(w0) / (2.0 * Q);
+    double a0    = 1.0 + alpha;
+    bank->b0 = biquad_to_q30(alpha / a0);
+    bank->b1 = 0;
+    bank->b2 = biquad_to_q30(-alpha / a0);
+    bank->a1 = biquad_to_q30(-2.0 * cos(w0) / a0);
+    bank->a2 = biquad_to_q30((1.0 - alpha) / a0);
+}
+
+// Initialise the bank for n channels with zero states (prime it with biquad_bank_reset() to avoid a settling phase)
+static inline void biquad_bank_init(BiquadBank *bank, int n) {
+    if (n > BIQUAD_MAX_CHANNELS) n = BIQUAD_MAX_CHANNELS;
+    bank->n = n;
+    for (int i = 0; i < n; i++) {
+        bank->x1[i] = bank->x2[i] = 0;
+        bank->y1[i] = bank->y2[i] = 0;
+        bank->err[i] = 0;
+    }
+}
+
+// Restart every channel in the steady state of the constant input x[i] and output y[i] (ADC units),
+// y = NULL: output 0 (band-pass, its DC gain is 0)
+static inline void biquad_bank_reset(BiquadBank *bank, const int *x, const int *y) {
+    for (int i = 0; i < bank->n; i++) {
+        bank->x1[i] = bank->x2[i] = x[i] * (1 << BIQUAD_SAMPLE_SHIFT);
+        bank->y1[i] = bank->y2[i] = y ? y[i] * (1 << BIQUAD_SAMPLE_SHIFT) : 0;
+        bank->err[i] = 0;
+    }
+}
+
+// Filter one sample of every channel: in[i] and out[i] are ADC units (int), out may equal in
+static inline void biquad_bank_process(BiquadBank *bank, const int *in, int *out) {
+    const int64_t b0 = bank->b0, b1 = bank->b1, b2 = bank->b2, a1 = bank->a1, a2 = bank->a2;
+    for (int i = 0; i < bank->n; i++) {
+        int32_t x = in[i] * (1 << BIQUAD_SAMPLE_SHIFT);   // multiplied: a left shift of a negative value is undefined
+        int64_t acc = (int64_t)bank->err[i]
+                    + b0 * x + b1 * bank->x1[i] + b2 * bank->x2[i]
+                    - a1 * bank->y1[i] - a2 * bank->y2[i];
+        int64_t y = acc >> BIQUAD_COEF_SHIFT;
+        bank->err[i] = (int32_t)(acc - y * ((int64_t)1 << BIQUAD_COEF_SHIFT));
+        if (y > BIQUAD_STATE_MAX) y = BIQUAD_STATE_MAX;
+        else if (y < -BIQUAD_STATE_MAX) y = -BIQUAD_STATE_MAX;
+
+        bank->x2[i] = bank->x1[i];
+        bank->x1[i] = x;
+        bank->y2[i] = bank->y1[i];
+        bank->y1[i] = (int32_t)y;
+        out[i] = (int32_t)y >> BIQUAD_SAMPLE_SHIFT;
+    }
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Precomputed lowpass coefficients (Q30, Q = 0.707) for the preset cutoff frequencies and
+    sample rates, generated by tools/biquad_presets.py - do not edit, run the script instead.
+    Other combinations are computed at runtime (see biquad_preset_lowpass()).
+*/
+
+#ifndef BIQUADPRESETS_H
+#define BIQUADPRESETS_H
+
+#include "biquadbank.h"
+
+typedef struct {
+    uint16_t sampleRate;                     // Hz
+    uint16_t cutoff;                         // Hz * 100
+    BiquadCoefs coefs;
+} BiquadPreset;
+
+#define BIQUAD_SIGNAL_PRESETS 8
+#define BIQUAD_BASELINE_PRESETS 5
+static const float biquadSignalCutoffs[BIQUAD_SIGNAL_PRESETS] = { 10.0f, 15.0f, 20.0f, 25.0f, 35.0f, 50.0f, 70.0f, 100.0f };
+static const float biquadBaselineCutoffs[BIQUAD_BASELINE_PRESETS] = { 0.3f, 0.5f, 0.8f, 1.2f, 2.0f };
+
+static const BiquadPreset biquadPresets[] = {
+    { 1000,  1000, {     1014349,     2028697,     1014349, -2052119049,   982434620 } },
+    { 1000,  1500, {     2233971,     4467942,     2233971, -2004541432,   939735492 } },
+    { 1000,  2000, {     3888703,     7777406,     3888703, -1957079710,   898892699 } },
+    { 1000,  2500, {     5951358,    11902716,     5951358, -1909762601,   859826208 } },
+    { 1000,  3500, {    11201492,    22402985,    11201492, -1815656887,   786721033 } },
+    { 1000,  5000, {    21563766,    43127531,    21563766, -1676085001,   688598239 } },
+    { 1000,  7000, {    39270558,    78541117,    39270558, -1493410242,   576750652 } },
+    { 1000, 10000, {    72426337,   144852674,    72426337, -1227211551,   443175075 } },
+    { 1000,    30, {         952,        1905,         952, -2144620913,  1070882899 } },
+    { 1000,    50, {        2643,        5287,        2643, -2142712429,  1068981179 } },
+    { 1000,    80, {        6758,       13517,        6758, -2139849721,  1066134930 } },
+    { 1000,   120, {       15179,       30359,       15179, -2136032823,  1062351716 } },
+    { 1000,   200, {       42016,       84031,       42016, -2128399275,  1054825514 } },
+    { 2000,  1000, {      259156,      518313,      259156, -2099779256,  1027074058 } },
+    { 2000,  1500, {      576779,     1153558,      576779, -2075941103,  1004506395 } },
+    { 2000,  2000, {     1014349,     2028697,     1014349, -2052119049,   982434620 } },
+    { 2000,  2500, {     1567990,     3135980,     1567990, -2028317722,   960847859 } },
+    { 2000,  3500, {     3008696,     6017391,     3008696, -1980794187,   919087146 } },
+    { 2000,  5000, {     5951358,    11902716,     5951358, -1909762601,   859826208 } },
+    { 2000,  7000, {    11201492,    22402985,    11201492, -1815656887,   786721033 } },
+    { 2000, 10000, {    21563766,    43127531,    21563766, -1676085001,   688598239 } },
+    { 2000,    30, {         238,         477,         238, -2146052280,  1072311409 } },
+    { 2000,    50, {         662,        1323,         662, -2145098035,  1071358857 } },
+    { 2000,    80, {        1693,        3385,        1693, -2143666670,  1069931617 } },
+    { 2000,   120, {        3805,        7610,        3805, -2141758190,  1068031586 } },
+    { 2000,   200, {       10550,       21101,       10550, -2137941264,  1064241642 } },
+    { 4000,  1000, {       65505,      131010,       65505, -2123628543,  1050148738 } },
+    { 4000,  1500, {      146577,      293154,      146577, -2111702832,  1038547315 } },
+    { 4000,  2000, {      259156,      518313,      259156, -2099779256,  1027074058 } },
+    { 4000,  2500, {      402726,      805453,      402726, -2087858469,  1015727551 } },
+    { 4000,  3500, {      780816,     1561632,      780816, -2064027767,   993409207 } },
+    { 4000,  5000, {     1567990,     3135980,     1567990, -2028317722,   960847859 } },
+    { 4000,  7000, {     3008696,     6017391,     3008696, -1980794187,   919087146 } },
+    { 4000, 10000, {     5951358,    11902716,     5951358, -1909762601,   859826208 } },
+    { 4000,    30, {          60,         119,          60, -2146767964,  1073026378 } },
+    { 4000,    50, {         165,         331,         165, -2146290841,  1072549679 } },
+    { 4000,    80, {         424,         847,         424, -2145575157,  1071835027 } },
+    { 4000,   120, {         952,        1905,         952, -2144620913,  1070882899 } },
+    { 4000,   200, {        2643,        5287,        2643, -2142712429,  1068981179 } },
+};
+
+// Lowpass coefficients for cutoff f at sampling rate fs: from the table if it is a preset, computed otherwise
+static inline void biquad_preset_lowpass(BiquadCoefs *coefs, float f, float fs) {
+    long cutoff = lroundf(f * 100.0f), rate = lroundf(fs);
+    for (unsigned int i = 0; i < sizeof(biquadPresets) / sizeof(biquadPresets[0]); i++) {
+        if (biquadPresets[i].sampleRate == rate && biquadPresets[i].cutoff == cutoff) {
+            *coefs = biquadPresets[i].coefs;
+            return;
+        }
+    }
+    biquad_lowpass_coefs(coefs, f, 0.707f, fs);
+}
+
+#endif
@@ -0,0 +1,573 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Filter and trigger logic of the FloorSensorReader (one scan of all channels at a time).
+    This header has no Arduino dependencies, so the same code runs in the sketch and on
+    the host (see tools/replay, which runs recorded raw traces through it).
+    The tuning constants below can be overridden with -D flags for offline tuning.
+
+    Per scan and channel:
+      - signal (35 Hz lowpass) and baseline (0.8 Hz lowpass), sensor value = signal - baseline;
+        the coefficients of preset cutoffs come from biquadpresets.h, sensordsp_retune() changes a
+        cutoff at runtime, the new coefficients are swapped in at the start of the next scan
+      - adaptive threshold: the noise level (average absolute sensor value) is averaged over the
+        second half of a calibration phase after startup and tracked while the channel is idle, the on-threshold
+        is a multiple of it (at least the minimum threshold of the profile), the off-threshold adds
+        hysteresis, a refractory period after each release suppresses double triggers
+      - footstep classifier (FSR profile): slow body-weight shifts pass the baseline subtraction,
+        so an onset is only accepted if it is impulsive: the energy of a band-pass (SENSOR_BAND_CENTER,
+        second biquad bank) has to be at least SENSOR_IMPULSE_RATIO percent of the energy of the
+        sensor value, both averaged over a short window (2^SENSOR_CLASSIFIER_SHIFT scans)
+      - fast onset path (SENSOR_FAST_ONSET): fires on the first steep rise of the raw signal
+        (slope above a multiple of the slope noise), the lowpass detector has to confirm it
+        within SENSOR_CONFIRM_TIME, otherwise it is released; the release is always decided
+        by the lowpass detector. The lead of the fast path is collected in a histogram.
+      - crosstalk compensation (SENSOR_CROSSTALK): a stomp on one pad makes the neighbouring
+        sensors ring, so a learned fraction of the SENSOR_CROSSTALK_SPAN neighbours on each side
+        is subtracted from the sensor value and the raw slope before thresholding (banded
+        fixed-point matrix-vector product, Q15 coefficients). During a calibration the pads are
+        hit one at a time, for the dominant channel of each scan (first active, SENSOR_CROSSTALK_DOMINANCE
+        times stronger than the others nearby, rising or near its peak) the least squares ratio
+        neighbour/source is accumulated and turned into the coefficients at the end.
+      - trigger integrator: a stronger impact creates a longer on-phase of the trigger value,
+        the trigger state of all channels is kept in a bitset of 32 bit words (bit i & 31 of
+        word i >> 5), so callers detect changes of 32 channels with one XOR
+      - hit features: from each onset until the release (at most SENSOR_HIT_WINDOW) the peak of the
+        undecimated samples above the baseline (the peak input of sensordsp_process(), a decimated
+        mean would flatten short piezo transients), the rise time to the peak and the energy (sum of
+        the squared deviation of the raw signal) are accumulated; completed hits are flagged once in hitReady
+*/
+
+#ifndef SENSORDSP_H
+#define SENSORDSP_H
+
+#include <stdint.h>
+#include <string.h>
+#include "biquadbank.h"
+#include "biquadpresets.h"
+
+#ifndef TRIGGER_SIGNAL_LOWPASS_CUTOFF
+#define TRIGGER_SIGNAL_LOWPASS_CUTOFF   35.0f   // cutoff frequency for trigger signal
+#endif
+#ifndef BASELINE_SIGNAL_LOWPASS_CUTOFF
+#define BASELINE_SIGNAL_LOWPASS_CUTOFF   0.8f   // cutoff frequency for baseline signal
+#endif
+
+// detector profiles for the physical sensors, selectable at runtime (sensordsp_set_profile())
+#define SENSORDSP_PROFILE_PIEZO 0
+#define SENSORDSP_PROFILE_FSR   1
+
+#define SENSOR_THRESHOLD_PIEZO 8       // minimum of the adaptive threshold (piezo profile)
+#define SENSOR_THRESHOLD_FSR 100       // minimum of the adaptive threshold (FSR profile)
+
+#ifndef SENSOR_PROFILE
+#define SENSOR_PROFILE SENSORDSP_PROFILE_FSR   // use appropriate profile for the physical sensor (piezo or FSR)
+#endif
+
+#ifndef SENSOR_BAND_CENTER
+#define SENSOR_BAND_CENTER 15.0f       // center frequency of the classifier band-pass (Hz)
+#endif
+#ifndef SENSOR_IMPULSE_RATIO
+#define SENSOR_IMPULSE_RATIO 25        // minimum band energy at an onset, in percent of the sensor value energy
+#endif
+#ifndef SENSOR_CLASSIFIER_SHIFT
+#define SENSOR_CLASSIFIER_SHIFT 5      // energy averaging window: 2^5 scans (about 32 ms)
+#endif
+
+#ifndef SENSOR_NOISE_FACTOR
+#define SENSOR_NOISE_FACTOR 6          // on-threshold = noise level * factor (at least the minimum threshold of the profile)
+#endif
+#ifndef SENSOR_HYSTERESIS
+#define SENSOR_HYSTERESIS 50           // off-threshold in percent of the on-threshold
+#endif
+#ifndef SENSOR_NOISE_SHIFT
+#define SENSOR_NOISE_SHIFT 10          // time constant of the noise tracking: 2^10 scans (about 1 s)
+#endif
+#ifndef SENSOR_REFRACTORY_TIME
+#define SENSOR_REFRACTORY_TIME 30      // time after a release during which the channel cannot trigger (in milliseconds)
+#endif
+#ifndef SENSOR_CALIBRATION_TIME
+#define SENSOR_CALIBRATION_TIME 2000   // startup time: filters settle during the first half, noise is measured in the second half
+#endif
+
+#ifndef SENSOR_FAST_ONSET
+#define SENSOR_FAST_ONSET 1            // if 1: fire onsets on the slope of the raw signal (confirmed by the lowpass detector)
+#endif
+#ifndef SENSOR_FAST_SLOPE_FACTOR
+#define SENSOR_FAST_SLOPE_FACTOR 8     // slope threshold = slope noise * factor
+#endif
+#ifndef SENSOR_FAST_MIN_SLOPE
+#define SENSOR_FAST_MIN_SLOPE 20       // minimum slope threshold (ADC units per scan)
+#endif
+#ifndef SENSOR_CONFIRM_TIME
+#define SENSOR_CONFIRM_TIME 15         // fast onsets not confirmed by the lowpass detector within this time (ms) are released
+#endif
+
+#ifndef SENSOR_CROSSTALK
+#define SENSOR_CROSSTALK 1             // if 1: subtract the learned crosstalk of the neighbouring channels
+#endif
+#ifndef SENSOR_CROSSTALK_SPAN
+#define SENSOR_CROSSTALK_SPAN 2        // neighbours on each side which are compensated
+#endif
+#ifndef SENSOR_CROSSTALK_MAX
+#define SENSOR_CROSSTALK_MAX 50        // maximum crosstalk coefficient (in percent)
+#endif
+#ifndef SENSOR_CROSSTALK_MIN_SAMPLES
+#define SENSOR_CROSSTALK_MIN_SAMPLES 100   // scans with a dominant neighbour needed to learn a coefficient
+#endif
+#ifndef SENSOR_CROSSTALK_DOMINANCE
+#define SENSOR_CROSSTALK_DOMINANCE 2   // learning: the source must exceed every other channel within 2*SPAN this many times
+#endif                                 // (couplings up to 1/DOMINANCE can be learned, see SENSOR_CROSSTALK_MAX)
+#ifndef SENSOR_CROSSTALK_PEAK_RATIO
+#define SENSOR_CROSSTALK_PEAK_RATIO 75 // learning: only while the source is at least this percentage of its peak (rise and peak, no ring-down)
+#endif
+
+#ifndef SENSOR_HIT_WINDOW
+#define SENSOR_HIT_WINDOW 30           // hit features are measured for this time after the onset (ms) or until the release
+#endif
+#ifndef SENSOR_HIT_ENERGY_SHIFT
+#define SENSOR_HIT_ENERGY_SHIFT 8      // unit of the hit energy: sum of the squared deviation / 2^shift per scan
+#endif
+
+// trigger constants are applied per scan (tuned for a sample rate of 1000 Hz)
+#ifndef SENSOR_IMPACT_VAL
+#define SENSOR_IMPACT_VAL 20
+#endif
+#ifndef SENSOR_TRIGGER_MAXVALUE
+#define SENSOR_TRIGGER_MAXVALUE 1000
+#endif
+#ifndef SENSOR_DECAY
+#define SENSOR_DECAY 10
+#endif
+
+#define SENSORDSP_MAX_CHANNELS BIQUAD_MAX_CHANNELS
+#define SENSORDSP_WORDS ((SENSORDSP_MAX_CHANNELS + 31) / 32)   // 32 bit words of a channel bitset
+#define SENSORDSP_LEAD_BINS 64                    // histogram bins for the fast onset lead (in scans)
+#define SENSORDSP_NEIGHBOURS (2 * SENSOR_CROSSTALK_SPAN)
+#define SENSORDSP_CROSSTALK_SHIFT 15              // Q15 crosstalk coefficients
+
+// sensordsp_process() result flags
+// filters of sensordsp_retune()
+#define SENSORDSP_SIGNAL_FILTER   0
+#define SENSORDSP_BASELINE_FILTER 1
+
+#define SENSORDSP_CALIBRATED 0x01                 // calibration finished in this scan
+#define SENSORDSP_HITS       0x02                 // features of at least one hit are complete (see hitReady)
+
+typedef struct {
+    int n;                                        // number of channels
+    int calibrationScans, refractoryScans, confirmScans;   // time constants in scans
+    uint32_t scans;                               // processed scans (counts up to calibrationScans)
+
+    BiquadBank signalFilter, baselineFilter;      // fixed-point lowpass filters for all channels
+    BiquadBank bandFilter;                        // band-pass of the footstep classifier
+    float sampleRate;
+    float cutoff[2];                              // Hz, index SENSORDSP_*_FILTER
+    BiquadCoefs pendingCoefs[2];                  // retuned coefficients, swapped in by the next sensordsp_process()
+    volatile uint8_t pending;                     // bit per filter: pendingCoefs are valid
+    int profile;                                  // SENSORDSP_PROFILE_*
+    int minThreshold;                             // minimum of the adaptive threshold (from the profile)
+    uint8_t classifier;                           // 1: onsets have to be impulsive (from the profile)
+    int raw[SENSORDSP_MAX_CHANNELS], prevRaw[SENSORDSP_MAX_CHANNELS];
+    int peak[SENSORDSP_MAX_CHANNELS];             // maximum sample of the scan period (= raw without oversampling)
+    int signal[SENSORDSP_MAX_CHANNELS], baseline[SENSORDSP_MAX_CHANNELS];
+    int sensorVal[SENSORDSP_MAX_CHANNELS];        // signal - baseline
+
+    int32_t noiseLevel[SENSORDSP_MAX_CHANNELS];   // average absolute deviation from the baseline (Q12)
+    int32_t slopeNoise[SENSORDSP_MAX_CHANNELS];   // average absolute slope of the raw signal (Q12)
+    uint32_t noiseSum[SENSORDSP_MAX_CHANNELS], slopeSum[SENSORDSP_MAX_CHANNELS];   // calibration: sums of the magnitudes
+    int onThreshold[SENSORDSP_MAX_CHANNELS], offThreshold[SENSORDSP_MAX_CHANNELS];
+    int band[SENSORDSP_MAX_CHANNELS];             // band-pass of the raw signal (classifier)
+    int32_t bandEnergy[SENSORDSP_MAX_CHANNELS], signalEnergy[SENSORDSP_MAX_CHANNELS];   // averaged squares
+    uint32_t slowRejected;                        // onsets rejected by the classifier
+    uint8_t aboveThreshold[SENSORDSP_MAX_CHANNELS];
+    uint8_t slowLoad[SENSORDSP_MAX_CHANNELS];     // above the threshold, but rejected by the classifier
+    uint8_t slowActive[SENSORDSP_MAX_CHANNELS];   // result of the lowpass detector in the previous scan
+    uint16_t refractory[SENSORDSP_MAX_CHANNELS];  // remaining scans of the refractory period
+    uint16_t fastScans[SENSORDSP_MAX_CHANNELS];   // scans since an unconfirmed fast onset (0 = none)
+
+    int triggers[SENSORDSP_MAX_CHANNELS];
+    uint32_t triggerBits[SENSORDSP_WORDS];
+    uint32_t muted[SENSORDSP_WORDS];              // muted channels never trigger (see sensorhealth.h)
+
+    // hit features, valid from the onset until the next onset of the channel
+    uint16_t hitScans[SENSORDSP_MAX_CHANNELS];    // scans since the onset while measuring (0 = complete)
+    uint16_t hitRise[SENSORDSP_MAX_CHANNELS];     // scans from the onset to the peak
+    int hitPeak[SENSORDSP_MAX_CHANNELS];          // maximum peak value above the baseline (ADC units)
+    uint32_t hitEnergy[SENSORDSP_MAX_CHANNELS];   // sum of the squared deviation >> SENSOR_HIT_ENERGY_SHIFT
+    uint32_t hitReady[SENSORDSP_WORDS];           // set when the features are complete, cleared by the caller
+    int hitWindow;                                // SENSOR_HIT_WINDOW in scans
+
+    uint32_t leadHistogram[SENSORDSP_LEAD_BINS];  // lead of the fast path over the lowpass detector (in scans)
+    uint32_t fastRejected;
+
+    // crosstalk[i][k]: fraction of neighbour i-SPAN .. i+SPAN (without i itself) contained in channel i (Q15)
+    int16_t crosstalk[SENSORDSP_MAX_CHANNELS][SENSORDSP_NEIGHBOURS];
+    uint8_t crosstalkCalibrating;
+    int64_t crosstalkCorr[SENSORDSP_MAX_CHANNELS][SENSORDSP_NEIGHBOURS];    // sum neighbour * source
+    int64_t crosstalkPower[SENSORDSP_MAX_CHANNELS][SENSORDSP_NEIGHBOURS];   // sum source * source
+    uint16_t crosstalkSamples[SENSORDSP_MAX_CHANNELS][SENSORDSP_NEIGHBOURS];
+    int crosstalkPeak[SENSORDSP_MAX_CHANNELS];    // peak of the current excursion above the on-threshold
+    uint8_t crosstalkLead[SENSORDSP_MAX_CHANNELS];  // the excursion began while the channels nearby were quiet
+    uint16_t crosstalkQuiet[SENSORDSP_MAX_CHANNELS];  // scans since the channel was last above the on-threshold
+} SensorDsp;
+
+static inline int sensordsp_bit(const SensorDsp *dsp, int i) {
+    return (dsp->triggerBits[i >> 5] >> (i & 31)) & 1;
+}
+
+static inline void sensordsp_init(SensorDsp *dsp, int n, int sampleRate) {
+    memset(dsp, 0, sizeof(SensorDsp));
+    dsp->n = n > SENSORDSP_MAX_CHANNELS ? SENSORDSP_MAX_CHANNELS : n;
+    dsp->calibrationScans = SENSOR_CALIBRATION_TIME * sampleRate / 1000;
+    dsp->refractoryScans = SENSOR_REFRACTORY_TIME * sampleRate / 1000;
+    dsp->confirmScans = SENSOR_CONFIRM_TIME * sampleRate / 1000;
+    dsp->hitWindow = SENSOR_HIT_WINDOW * sampleRate / 1000;
+    if (dsp->hitWindow > 0xFFFF) dsp->hitWindow = 0xFFFF;
+    if (dsp->confirmScans >= SENSORDSP_LEAD_BINS) dsp->confirmScans = SENSORDSP_LEAD_BINS - 1;
+    BiquadCoefs coefs;
+    dsp->sampleRate = (float)sampleRate;
+    dsp->cutoff[SENSORDSP_SIGNAL_FILTER] = TRIGGER_SIGNAL_LOWPASS_CUTOFF;
+    dsp->cutoff[SENSORDSP_BASELINE_FILTER] = BASELINE_SIGNAL_LOWPASS_CUTOFF;
+    biquad_preset_lowpass(&coefs, TRIGGER_SIGNAL_LOWPASS_CUTOFF, dsp->sampleRate);
+    biquad_bank_set_coefs(&dsp->signalFilter, &coefs);
+    biquad_preset_lowpass(&coefs, BASELINE_SIGNAL_LOWPASS_CUTOFF, dsp->sampleRate);
+    biquad_bank_set_coefs(&dsp->baselineFilter, &coefs);
+    biquad_bank_bandpass(&dsp->bandFilter, SENSOR_BAND_CENTER, 0.707f, (float)sampleRate);
+    biquad_bank_init(&dsp->signalFilter, dsp->n);     // primed with the first scan (sensordsp_process())
+    biquad_bank_init(&dsp->baselineFilter, dsp->n);
+    biquad_bank_init(&dsp->bandFilter, dsp->n);
+    dsp->profile = SENSOR_PROFILE;
+    dsp->minThreshold = SENSOR_PROFILE == SENSORDSP_PROFILE_PIEZO ? SENSOR_THRESHOLD_PIEZO : SENSOR_THRESHOLD_FSR;
+    dsp->classifier = SENSOR_PROFILE == SENSORDSP_PROFILE_FSR;
+}
+
+static inline void sensordsp_update_threshold(SensorDsp *dsp, int i) {
+    int threshold = (dsp->noiseLevel[i] * SENSOR_NOISE_FACTOR) >> 12;
+    if (threshold < dsp->minThreshold) threshold = dsp->minThreshold;
+    dsp->onThreshold[i] = threshold;
+    dsp->offThreshold[i] = threshold * SENSOR_HYSTERESIS / 100;
+}
+
+// Switch the detector profile (SENSORDSP_PROFILE_PIEZO or SENSORDSP_PROFILE_FSR) at runtime
+static inline void sensordsp_set_profile(SensorDsp *dsp, int profile) {
+    dsp->profile = profile;
+    dsp->minThreshold = profile == SENSORDSP_PROFILE_PIEZO ? SENSOR_THRESHOLD_PIEZO : SENSOR_THRESHOLD_FSR;
+    if (profile == SENSORDSP_PROFILE_FSR && !dsp->classifier) {
+        // the band-pass was not running: restart it settled on the current baseline, without stale energies
+        biquad_bank_reset(&dsp->bandFilter, dsp->baseline, NULL);
+        memset(dsp->band, 0, sizeof(dsp->band));
+        memset(dsp->bandEnergy, 0, sizeof(dsp->bandEnergy));
+        memset(dsp->signalEnergy, 0, sizeof(dsp->signalEnergy));
+    }
+    dsp->classifier = profile == SENSORDSP_PROFILE_FSR;
+    if (dsp->scans >= (uint32_t)dsp->calibrationScans)
+        for (int i = 0; i < dsp->n; i++) sensordsp_update_threshold(dsp, i);
+}
+
+// Change the cutoff of the signal or baseline lowpass (SENSORDSP_*_FILTER), takes effect with the next scan
+static inline void sensordsp_retune(SensorDsp *dsp, int filter, float cutoff) {
+    biquad_preset_lowpass(&dsp->pendingCoefs[filter], cutoff, dsp->sampleRate);
+    dsp->cutoff[filter] = cutoff;
+    dsp->pending |= 1 << filter;
+}
+
+// footstep classifier: 1 if the recent signal energy is mainly in the band-pass (impulsive)
+static inline int sensordsp_impulsive(const SensorDsp *dsp, int i) {
+    return (int64_t)dsp->bandEnergy[i] * 100 >= (int64_t)dsp->signalEnergy[i] * SENSOR_IMPULSE_RATIO;
+}
+
+// returns 1 while the channel is active (adaptive threshold with hysteresis and refractory period)
+static inline int sensordsp_detect_activity(SensorDsp *dsp, int i, int sensorVal) {
+    int magnitude = sensorVal < 0 ? -sensorVal : sensorVal;
+    if (dsp->scans < (uint32_t)dsp->calibrationScans) {
+        if (dsp->scans >= (uint32_t)dsp->calibrationScans / 2)   // filters have settled: sum up the noise
+            dsp->noiseSum[i] += magnitude;
+        return 0;
+    }
+
+    if (dsp->aboveThreshold[i]) {
+        if (sensorVal < dsp->offThreshold[i]) dsp->aboveThreshold[i] = 0;
+    }
+    else if (dsp->refractory[i]) dsp->refractory[i]--;
+    else if (sensorVal > dsp->onThreshold[i]) {
+        if (!dsp->classifier || sensordsp_impulsive(dsp, i)) dsp->aboveThreshold[i] = 1;
+        else if (!dsp->slowLoad[i]) {   // slow loading: count once until it falls below the threshold
+            dsp->slowRejected++;
+            dsp->slowLoad[i] = 1;
+        }
+    }
+    else dsp->slowLoad[i] = 0;
+
+    if (!dsp->aboveThreshold[i] && !dsp->triggers[i]) {   // track the noise only while the channel is idle
+        dsp->noiseLevel[i] += ((magnitude << 12) - dsp->noiseLevel[i]) >> SENSOR_NOISE_SHIFT;
+        sensordsp_update_threshold(dsp, i);
+    }
+    return dsp->aboveThreshold[i];
+}
+
+// fast onset path on the slope of the raw signal, active = result of the lowpass detector
+static inline void sensordsp_detect_fast_onset(SensorDsp *dsp, int i, int slope, int active) {
+    int magnitude = slope < 0 ? -slope : slope;
+    int rising = active && !dsp->slowActive[i];
+    dsp->slowActive[i] = active;
+    if (dsp->scans < (uint32_t)dsp->calibrationScans) {
+        if (dsp->scans >= (uint32_t)dsp->calibrationScans / 2)
+            dsp->slopeSum[i] += magnitude;
+        return;
+    }
+
+    if (dsp->fastScans[i]) {   // waiting for the confirmation by the lowpass detector
+        if (active) {
+            dsp->leadHistogram[dsp->fastScans[i]]++;
+            dsp->fastScans[i] = 0;
+        }
+        else if (++dsp->fastScans[i] > dsp->confirmScans) {
+            dsp->fastScans[i] = 0;
+            dsp->triggers[i] = 0;   // not confirmed: release
+            dsp->fastRejected++;
+        }
+        else if (dsp->triggers[i] <= SENSOR_DECAY) dsp->triggers[i] = SENSOR_DECAY + 1;   // hold until confirmed
+        return;
+    }
+    if (rising && !dsp->triggers[i]) dsp->leadHistogram[0]++;   // lowpass detector was first
+
+    int threshold = (dsp->slopeNoise[i] * SENSOR_FAST_SLOPE_FACTOR) >> 12;
+    if (threshold < SENSOR_FAST_MIN_SLOPE) threshold = SENSOR_FAST_MIN_SLOPE;
+    if (!dsp->triggers[i] && !active && !dsp->refractory[i]) {
+        if (slope > threshold) {
+            dsp->triggers[i] = SENSOR_IMPACT_VAL + SENSOR_DECAY;   // trigger bit is set in this scan
+            dsp->fastScans[i] = 1;
+        }
+        else dsp->slopeNoise[i] += ((magnitude << 12) - dsp->slopeNoise[i]) >> SENSOR_NOISE_SHIFT;
+    }
+}
+
+// index of neighbour j in the coefficient row of channel i (|j-i| = 1 .. SENSOR_CROSSTALK_SPAN)
+static inline int sensordsp_neighbour(int i, int j) {
+    return j < i ? j - i + SENSOR_CROSSTALK_SPAN : j - i + SENSOR_CROSSTALK_SPAN - 1;
+}
+
+// out[i] = in[i] - sum of crosstalk[i][k] * in[neighbour k] (in and out must differ)
+static inline void sensordsp_crosstalk_apply(const SensorDsp *dsp, const int *in, int *out) {
+    for (int i = 0; i < dsp->n; i++) {
+        const int16_t *c = dsp->crosstalk[i];
+        int first = i - SENSOR_CROSSTALK_SPAN;
+        int32_t acc = 0;
+        for (int k = 0; k < SENSORDSP_NEIGHBOURS; k++) {
+            int j = first + k + (k >= SENSOR_CROSSTALK_SPAN);   // skip the channel itself
+            if (j >= 0 && j < dsp->n) acc += c[k] * in[j];
+        }
+        out[i] = in[i] - ((acc + (1 << (SENSORDSP_CROSSTALK_SHIFT - 1))) >> SENSORDSP_CROSSTALK_SHIFT);
+    }
+}
+
+// Start learning the crosstalk: hit the pads one at a time until sensordsp_crosstalk_end()
+static inline void sensordsp_crosstalk_begin(SensorDsp *dsp) {
+    memset(dsp->crosstalkCorr, 0, sizeof(dsp->crosstalkCorr));
+    memset(dsp->crosstalkPower, 0, sizeof(dsp->crosstalkPower));
+    memset(dsp->crosstalkSamples, 0, sizeof(dsp->crosstalkSamples));
+    memset(dsp->crosstalkPeak, 0, sizeof(dsp->crosstalkPeak));
+    memset(dsp->crosstalkLead, 0, sizeof(dsp->crosstalkLead));
+    for (int i = 0; i < SENSORDSP_MAX_CHANNELS; i++) dsp->crosstalkQuiet[i] = 0xFFFF;
+    dsp->crosstalkCalibrating = 1;
+}
+
+// accumulate the response of the neighbours if one channel clearly dominates this scan: it is above its
+// threshold, its excursion began while the other channels nearby had been quiet for the refractory time
+// (a neighbour which rings on after the hit never leads), its peak is SENSOR_CROSSTALK_DOMINANCE times the value and peak of any
+// other channel within 2 * SPAN (no second pad active nearby) and it is rising or near its peak
+static inline void sensordsp_crosstalk_learn(SensorDsp *dsp, const int *sensorVal) {
+    if (dsp->n < 1) return;
+    int source = 0;
+    uint8_t started[SENSORDSP_MAX_CHANNELS];
+    for (int i = 0; i < dsp->n; i++) {
+        started[i] = sensorVal[i] > dsp->onThreshold[i] && !dsp->crosstalkPeak[i];
+        if (sensorVal[i] <= dsp->onThreshold[i]) dsp->crosstalkPeak[i] = 0;
+        else if (sensorVal[i] > dsp->crosstalkPeak[i]) dsp->crosstalkPeak[i] = sensorVal[i];
+        if (sensorVal[i] > sensorVal[source]) source = i;
+    }
+    for (int i = 0; i < dsp->n; i++) {   // quiet counts of the previous scan
+        if (!started[i]) continue;
+        dsp->crosstalkLead[i] = 1;
+        for (int j = i - 2 * SENSOR_CROSSTALK_SPAN; j <= i + 2 * SENSOR_CROSSTALK_SPAN; j++)
+            if (j >= 0 && j != i && j < dsp->n && dsp->crosstalkQuiet[j] <= dsp->refractoryScans) dsp->crosstalkLead[i] = 0;
+    }
+    for (int i = 0; i < dsp->n; i++) {
+        if (dsp->crosstalkPeak[i]) dsp->crosstalkQuiet[i] = 0;
+        else if (dsp->crosstalkQuiet[i] < 0xFFFF) dsp->crosstalkQuiet[i]++;
+    }
+    int32_t x = sensorVal[source];
+    if (x <= dsp->onThreshold[source] || !dsp->crosstalkLead[source]) return;
+    if ((int64_t)x * 100 < (int64_t)dsp->crosstalkPeak[source] * SENSOR_CROSSTALK_PEAK_RATIO) return;
+    for (int j = source - 2 * SENSOR_CROSSTALK_SPAN; j <= source + 2 * SENSOR_CROSSTALK_SPAN; j++) {
+        if (j < 0 || j == source || j >= dsp->n) continue;
+        int other = sensorVal[j] < 0 ? -sensorVal[j] : sensorVal[j];
+        if (dsp->crosstalkPeak[j] > other) other = dsp->crosstalkPeak[j];
+        if ((int64_t)other * SENSOR_CROSSTALK_DOMINANCE > dsp->crosstalkPeak[source]) return;
+    }
+
+    for (int j = source - SENSOR_CROSSTALK_SPAN; j <= source + SENSOR_CROSSTALK_SPAN; j++) {
+        if (j < 0 || j == source || j >= dsp->n) continue;
+        int k = sensordsp_neighbour(j, source);
+        if (dsp->crosstalkSamples[j][k] == 0xFFFF) continue;
+        dsp->crosstalkCorr[j][k] += (int64_t)sensorVal[j] * x;
+        dsp->crosstalkPower[j][k] += (int64_t)x * x;
+        dsp->crosstalkSamples[j][k]++;
+    }
+}
+
+// Finish learning: coefficients with enough samples are replaced, returns the number of learned coefficients
+static inline int sensordsp_crosstalk_end(SensorDsp *dsp) {
+    const int64_t limit = (int64_t)SENSOR_CROSSTALK_MAX * (1 << SENSORDSP_CROSSTALK_SHIFT) / 100;
+    int learned = 0;
+    dsp->crosstalkCalibrating = 0;
+    for (int i = 0; i < dsp->n; i++) {
+        for (int k = 0; k < SENSORDSP_NEIGHBOURS; k++) {
+            if (dsp->crosstalkSamples[i][k] < SENSOR_CROSSTALK_MIN_SAMPLES || !dsp->crosstalkPower[i][k]) continue;
+            int64_t c = dsp->crosstalkCorr[i][k] * (1 << SENSORDSP_CROSSTALK_SHIFT) / dsp->crosstalkPower[i][k];
+            if (c > limit) c = limit;
+            else if (c < -limit) c = -limit;
+            dsp->crosstalk[i][k] = (int16_t)c;
+            learned++;
+        }
+    }
+    return learned;
+}
+
+// accumulate the features of an open hit, returns 1 when the hit is complete
+static inline int sensordsp_track_hit(SensorDsp *dsp, int i, int released) {
+    int peak = dsp->peak[i] - dsp->baseline[i];
+    if (peak > dsp->hitPeak[i]) {
+        dsp->hitPeak[i] = peak;
+        dsp->hitRise[i] = dsp->hitScans[i] - 1;
+    }
+    int deviation = dsp->raw[i] - dsp->baseline[i];
+    if (deviation < 0) deviation = 0;
+    uint32_t energy = dsp->hitEnergy[i] + (((uint32_t)deviation * deviation) >> SENSOR_HIT_ENERGY_SHIFT);
+    dsp->hitEnergy[i] = energy < dsp->hitEnergy[i] ? 0xFFFFFFFF : energy;
+    if (!released && dsp->hitScans[i] < dsp->hitWindow) {
+        dsp->hitScans[i]++;
+        return 0;
+    }
+    dsp->hitScans[i] = 0;
+    dsp->hitReady[i >> 5] |= 1UL << (i & 31);
+    return 1;
+}
+
+// Process one scan of raw ADC values (n channels), returns SENSORDSP_* flags
+//   raw  = decimated (mean) values of the scan period, used by the filters and detectors
+//   peak = maximum values of the scan period, used for the hit peak (NULL: no oversampling, raw is used)
+static inline int sensordsp_process(SensorDsp *dsp, const int *raw, const int *peak) {
+    int flags = 0;
+    for (int i = 0; i < dsp->n; i++) {
+        dsp->raw[i] = raw[i];
+        dsp->peak[i] = peak ? peak[i] : raw[i];
+    }
+    if (dsp->pending) {   // retuned: swap the coefficients on the sample boundary, the filter states are kept
+        if (dsp->pending & (1 << SENSORDSP_SIGNAL_FILTER))
+            biquad_bank_set_coefs(&dsp->signalFilter, &dsp->pendingCoefs[SENSORDSP_SIGNAL_FILTER]);
+        if (dsp->pending & (1 << SENSORDSP_BASELINE_FILTER))
+            biquad_bank_set_coefs(&dsp->baselineFilter, &dsp->pendingCoefs[SENSORDSP_BASELINE_FILTER]);
+        dsp->pending = 0;
+    }
+    if (!dsp->scans) {   // first scan: start the filters in the steady state of it, the baseline need not climb from 0
+        biquad_bank_reset(&dsp->signalFilter, dsp->raw, dsp->raw);
+        biquad_bank_reset(&dsp->baselineFilter, dsp->raw, dsp->raw);
+        biquad_bank_reset(&dsp->bandFilter, dsp->raw, NULL);
+        memcpy(dsp->prevRaw, dsp->raw, dsp->n * sizeof(int));
+    }
+    biquad_bank_process(&dsp->signalFilter, dsp->raw, dsp->signal);       // 35 Hz LP (default)
+    biquad_bank_process(&dsp->baselineFilter, dsp->raw, dsp->baseline);   // 0.8 Hz LP (default)
+
+    int sensorVal[SENSORDSP_MAX_CHANNELS], slope[SENSORDSP_MAX_CHANNELS], fastSlope[SENSORDSP_MAX_CHANNELS];
+    for (int i = 0; i < dsp->n; i++) {
+        sensorVal[i] = dsp->signal[i] - dsp->baseline[i];
+        slope[i] = dsp->raw[i] - dsp->prevRaw[i];
+        dsp->prevRaw[i] = dsp->raw[i];
+    }
+    if (SENSOR_CROSSTALK) {   // the learning uses the uncompensated values
+        if (dsp->crosstalkCalibrating && dsp->scans >= (uint32_t)dsp->calibrationScans)
+            sensordsp_crosstalk_learn(dsp, sensorVal);
+        sensordsp_crosstalk_apply(dsp, sensorVal, dsp->sensorVal);
+        if (SENSOR_FAST_ONSET) sensordsp_crosstalk_apply(dsp, slope, fastSlope);
+    }
+    else {
+        memcpy(dsp->sensorVal, sensorVal, dsp->n * sizeof(int));
+        memcpy(fastSlope, slope, dsp->n * sizeof(int));
+    }
+    if (dsp->classifier) {   // short-time energies of the band-pass and of the sensor value
+        biquad_bank_process(&dsp->bandFilter, dsp->raw, dsp->band);
+        for (int i = 0; i < dsp->n; i++) {
+            int32_t b = dsp->band[i], v = dsp->sensorVal[i];
+            if (b > 32767 || b < -32767) b = 32767;
+            if (v > 32767 || v < -32767) v = 32767;
+            dsp->bandEnergy[i] += (b * b - dsp->bandEnergy[i]) >> SENSOR_CLASSIFIER_SHIFT;
+            dsp->signalEnergy[i] += (v * v - dsp->signalEnergy[i]) >> SENSOR_CLASSIFIER_SHIFT;
+        }
+    }
+
+    for (int i = 0; i < dsp->n; i++) {
+        int active = sensordsp_detect_activity(dsp, i, dsp->sensorVal[i]);
+        if (SENSOR_FAST_ONSET) sensordsp_detect_fast_onset(dsp, i, fastSlope[i], active);
+        uint32_t mask = 1UL << (i & 31);
+        if (dsp->muted[i >> 5] & mask) {
+            active = 0;
+            dsp->triggers[i] = 0;
+            dsp->fastScans[i] = 0;
+        }
+        if (active && (dsp->triggers[i] < SENSOR_TRIGGER_MAXVALUE))
+            dsp->triggers[i] += SENSOR_IMPACT_VAL;
+
+        int released = 0;
+        if (dsp->triggers[i] > SENSOR_DECAY) {
+            dsp->triggers[i] -= SENSOR_DECAY;
+            if (!(dsp->triggerBits[i >> 5] & mask)) {   // onset: start measuring the hit
+                dsp->hitScans[i] = 1;
+                dsp->hitPeak[i] = 0;
+                dsp->hitEnergy[i] = 0;
+                dsp->hitReady[i >> 5] &= ~mask;
+            }
+            dsp->triggerBits[i >> 5] |= mask;
+        }
+        else {
+            if (dsp->triggerBits[i >> 5] & mask) {
+                dsp->refractory[i] = dsp->refractoryScans;
+                released = 1;
+            }
+            dsp->triggers[i] = 0;
+            dsp->triggerBits[i >> 5] &= ~mask;
+        }
+        if (dsp->hitScans[i] && sensordsp_track_hit(dsp, i, released)) flags |= SENSORDSP_HITS;
+    }
+
+    if (dsp->scans < (uint32_t)dsp->calibrationScans && ++dsp->scans == (uint32_t)dsp->calibrationScans) {
+        // noise levels: averages over the second half of the calibration time
+        uint32_t count = dsp->calibrationScans - dsp->calibrationScans / 2;
+        for (int i = 0; i < dsp->n; i++) {
+            dsp->noiseLevel[i] = (int32_t)(((int64_t)dsp->noiseSum[i] << 12) / count);
+            dsp->slopeNoise[i] = (int32_t)(((int64_t)dsp->slopeSum[i] << 12) / count);
+            sensordsp_update_threshold(dsp, i);
+        }
+        flags |= SENSORDSP_CALIBRATED;
+    }
+    return flags;
+}
+
+// total number of onsets, median and maximum lead of the fast onset path (in scans)
+static inline uint32_t sensordsp_lead_stats(const SensorDsp *dsp, int *median, int *maximum) {
+    uint32_t total = 0, count = 0;
+    *median = *maximum = 0;
+    for (int i = 0; i < SENSORDSP_LEAD_BINS; i++) {
+        total += dsp->leadHistogram[i];
+        if (dsp->leadHistogram[i]) *maximum = i;
+    }
+    for (int i = 0; i < SENSORDSP_LEAD_BINS; i++) {
+        count += dsp->leadHistogram[i];
+        if (count * 2 >= total) { *median = i; break; }
+    }
+    return total;
+}
+
+#endif
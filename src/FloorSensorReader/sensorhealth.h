@@ -0,0 +1,143 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Self-diagnostics of the sensor channels: rolling statistics per channel, collected
+    incrementally for every scan (a multiply-add and two compares per channel, onsets are
+    found word-wide in the trigger bitset) and evaluated once per HEALTH_PERIOD:
+      - noise RMS of the sensor value while the channel is idle (Q4, ADC units * 16)
+      - baseline
+      - saturation count (raw value at the ADC limits, e.g. a broken cable or a short)
+      - trigger rate (onsets per period)
+    A channel that fires more than HEALTH_MAX_TRIGGERS onsets in HEALTH_FLOOD_PERIODS
+    consecutive periods is muted (see SensorDsp.muted) for HEALTH_MUTE_PERIODS, then it is
+    enabled again and re-checked. A channel without any noise at the ADC limits is reported
+    as silent. No Arduino dependencies (runs in tools/replay as well).
+*/
+
+#ifndef SENSORHEALTH_H
+#define SENSORHEALTH_H
+
+#include <stdint.h>
+#include <string.h>
+#include "sensordsp.h"
+
+#ifndef HEALTH_PERIOD
+#define HEALTH_PERIOD 1000             // statistics period (in milliseconds)
+#endif
+#ifndef HEALTH_MAX_TRIGGERS
+#define HEALTH_MAX_TRIGGERS 8          // more onsets per period are implausible for a person stomping
+#endif
+#ifndef HEALTH_FLOOD_PERIODS
+#define HEALTH_FLOOD_PERIODS 5         // consecutive periods above HEALTH_MAX_TRIGGERS before a channel is muted
+#endif
+#ifndef HEALTH_MUTE_PERIODS
+#define HEALTH_MUTE_PERIODS 60         // periods a flooding channel stays muted before it is re-checked
+#endif
+#ifndef HEALTH_ADC_MAX
+#define HEALTH_ADC_MAX 1023            // highest ADC value (10 bit resolution)
+#endif
+#define HEALTH_SATURATION_MARGIN 2     // raw values within this distance of 0 or HEALTH_ADC_MAX count as saturated
+
+// health_evaluate() result flags
+#define HEALTH_MUTED   0x01            // channel is muted
+#define HEALTH_SILENT  0x02            // no noise at all and baseline at an ADC limit (cable broken?)
+
+typedef struct {
+    int n;
+    uint32_t periodScans, scans;
+    uint32_t lastBits[SENSORDSP_WORDS];           // trigger states of the previous scan
+
+    // accumulators of the current period
+    uint64_t noisePower[SENSORDSP_MAX_CHANNELS];  // sum of the squared sensor values of idle scans
+    uint32_t idleScans[SENSORDSP_MAX_CHANNELS];
+    uint16_t saturated[SENSORDSP_MAX_CHANNELS];
+    uint16_t onsets[SENSORDSP_MAX_CHANNELS];
+
+    // results of the last period (valid after health_update() returned 1)
+    uint16_t noiseRms[SENSORDSP_MAX_CHANNELS];    // Q4
+    uint16_t lastSaturated[SENSORDSP_MAX_CHANNELS];
+    uint16_t lastOnsets[SENSORDSP_MAX_CHANNELS];
+    uint8_t status[SENSORDSP_MAX_CHANNELS];       // HEALTH_* flags
+
+    uint8_t floodPeriods[SENSORDSP_MAX_CHANNELS];
+    uint8_t mutePeriods[SENSORDSP_MAX_CHANNELS];  // remaining periods of a mute
+} SensorHealth;
+
+static inline uint32_t health_isqrt(uint32_t v) {
+    uint32_t root = 0, bit = 1UL << 30;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else root >>= 1;
+        bit >>= 2;
+    }
+    return root;
+}
+
+static inline void health_init(SensorHealth *h, int n, int sampleRate) {
+    memset(h, 0, sizeof(SensorHealth));
+    h->n = n > SENSORDSP_MAX_CHANNELS ? SENSORDSP_MAX_CHANNELS : n;
+    h->periodScans = (uint32_t)HEALTH_PERIOD * sampleRate / 1000;
+}
+
+// Collect the statistics of one processed scan, returns 1 when a period is complete (call health_evaluate())
+static inline int health_update(SensorHealth *h, const SensorDsp *dsp) {
+    for (int i = 0; i < h->n; i++) {
+        int raw = dsp->raw[i];
+        if (raw <= HEALTH_SATURATION_MARGIN || raw >= HEALTH_ADC_MAX - HEALTH_SATURATION_MARGIN) h->saturated[i]++;
+        if (!((dsp->triggerBits[i >> 5] >> (i & 31)) & 1)) {
+            int32_t v = dsp->sensorVal[i];
+            h->noisePower[i] += (uint32_t)(v * v);
+            h->idleScans[i]++;
+        }
+    }
+    for (int w = 0; w < SENSORDSP_WORDS; w++) {
+        for (uint32_t onsets = dsp->triggerBits[w] & ~h->lastBits[w]; onsets; onsets &= onsets - 1)
+            h->onsets[w * 32 + __builtin_ctz(onsets)]++;
+        h->lastBits[w] = dsp->triggerBits[w];
+    }
+    return ++h->scans >= h->periodScans;
+}
+
+// End of a period: compute the results, mute flooding channels (and re-enable them after HEALTH_MUTE_PERIODS)
+static inline void health_evaluate(SensorHealth *h, SensorDsp *dsp) {
+    for (int i = 0; i < h->n; i++) {
+        uint32_t mask = 1UL << (i & 31);
+        uint32_t meanPower = h->idleScans[i] ? (uint32_t)(h->noisePower[i] / h->idleScans[i]) : 0;
+        h->noiseRms[i] = meanPower < (1UL << 24) ? health_isqrt(meanPower << 8) : 0xFFFF;
+        h->lastSaturated[i] = h->saturated[i];
+        h->lastOnsets[i] = h->onsets[i];
+
+        if (h->onsets[i] > HEALTH_MAX_TRIGGERS) {
+            if (h->floodPeriods[i] < 255) h->floodPeriods[i]++;
+        }
+        else h->floodPeriods[i] = 0;
+
+        if (dsp->muted[i >> 5] & mask) {
+            if (h->mutePeriods[i]) h->mutePeriods[i]--;
+            else {
+                dsp->muted[i >> 5] &= ~mask;   // re-check the channel
+                h->floodPeriods[i] = 0;
+            }
+        }
+        else if (h->floodPeriods[i] >= HEALTH_FLOOD_PERIODS) {
+            dsp->muted[i >> 5] |= mask;
+            h->mutePeriods[i] = HEALTH_MUTE_PERIODS;
+        }
+
+        h->status[i] = (dsp->muted[i >> 5] & mask) ? HEALTH_MUTED : 0;
+        if (h->noiseRms[i] == 0 && h->saturated[i] >= h->scans) h->status[i] |= HEALTH_SILENT;
+
+        h->noisePower[i] = 0;
+        h->idleScans[i] = 0;
+        h->saturated[i] = 0;
+        h->onsets[i] = 0;
+    }
+    h->scans = 0;
+}
+
+#endif
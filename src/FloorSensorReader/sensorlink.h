@@ -0,0 +1,330 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Framed binary protocol for the Serial1 link between the FloorSensorReader
+    and the Teensy4.1. This header is shared by both firmwares (encoder and decoder).
+
+    Frame layout:
+      SYNC (0xA5) | LEN | SEQ | TYPE | PAYLOAD (LEN bytes) | CRC8
+
+    LEN is the payload length, SEQ is incremented for every frame by the sender,
+    CRC8 (polynomial 0x07) covers LEN, SEQ, TYPE and PAYLOAD.
+    Multi-byte values are little endian.
+    Channel numbering follows the sensor inputs: channel i belongs to player i/2,
+    even channels are trigger1, odd channels are trigger2.
+
+    Link mode negotiation: both sides start at SLINK_DEFAULT_BAUD. The sensor board sends
+    LINK_REQUEST frames with its preferred baud rate, the Teensy answers with LINK_ACK
+    (at the old rate) and both switch. A rate outside SLINK_DEFAULT_BAUD .. maximum of the receiver
+    (e.g. a corrupted frame which passed the CRC) is ignored, so both sides keep the old rate.
+    The Teensy acknowledges every KEYFRAME, so either
+    side falls back to SLINK_DEFAULT_BAUD if it hears nothing valid for SLINK_LINK_TIMEOUT.
+
+    Clock synchronisation: the Teensy sends PING frames with its micros() timestamp,
+    the sensor board answers with a PONG that echoes it and adds its own micros() at reception.
+    As the transmission time of the PING is known from the baud rate, the Teensy can estimate
+    the offset between both clocks (and the drift over several PINGs), and convert the
+    source timestamps in STATES frames into its own time domain.
+*/
+
+#ifndef SENSORLINK_H
+#define SENSORLINK_H
+
+#include <stdint.h>
+
+#define SLINK_SYNC          0xA5
+#define SLINK_HEADER_SIZE   4      // SYNC, LEN, SEQ, TYPE
+#define SLINK_MAX_PAYLOAD   64
+#define SLINK_MAX_FRAME     (SLINK_HEADER_SIZE + SLINK_MAX_PAYLOAD + 1)
+#define SLINK_MAX_CHANNELS  64
+
+#define SLINK_DEFAULT_BAUD      115200
+#define SLINK_KEYFRAME_PERIOD   250    // full trigger state is sent at least every 250 ms
+#define SLINK_LINK_TIMEOUT      1000   // fall back to SLINK_DEFAULT_BAUD if nothing valid is received for 1 s
+#define SLINK_REQUEST_PERIOD    500    // repeat LINK_REQUEST every 500 ms until acknowledged
+#define SLINK_HEARTBEAT_PERIOD  50     // heartbeat from the sampling loop every 50 ms
+#define SLINK_PING_FRAME_SIZE   (SLINK_HEADER_SIZE + 4 + 1)
+
+// 1 if a negotiated baud rate is plausible for a receiver supporting up to maxBaud
+static inline int slink_baud_valid(uint32_t baud, uint32_t maxBaud) {
+    return baud >= SLINK_DEFAULT_BAUD && baud <= maxBaud;
+}
+
+// Frame types
+#define SLINK_TYPE_STATES   0x01   // payload: channel count, trigger state bitset (LSB of first byte = channel 0),
+                                   //          [age in us (u16), source timestamp in sensor micros (u32)]
+#define SLINK_TYPE_HITS     0x02   // payload: n * (channel, velocity 1-127, position 0-254 or SLINK_POSITION_UNKNOWN)
+#define SLINK_TYPE_KEYFRAME 0x03   // same payload as STATES, sent periodically even without changes
+#define SLINK_TYPE_HEARTBEAT 0x04  // payload: CRC errors (u16) and lost frames (u16) seen by the sensor board
+#define SLINK_TYPE_ENVELOPE  0x05  // payload: samples per channel n, then per active channel:
+                                   //          channel, first sample (u8), n-1 deltas (s8, saturated)
+#define SLINK_TYPE_FEATURES  0x06  // payload: n * (channel, peak (u16, ADC units above baseline),
+                                   //          rise time (u16, us), energy (u16, saturated)), once per hit
+#define SLINK_TYPE_LINK_REQUEST 0x10   // sensor -> Teensy, payload: requested baud rate (u32)
+#define SLINK_TYPE_LINK_ACK     0x11   // Teensy -> sensor, payload: accepted baud rate (u32)
+#define SLINK_TYPE_PING         0x20   // Teensy -> sensor, payload: Teensy micros at sending (u32)
+#define SLINK_TYPE_PONG         0x21   // sensor -> Teensy, payload: echoed Teensy micros (u32), sensor micros at reception (u32)
+
+#define SLINK_AGE_UNKNOWN 0xFFFF
+
+#define SLINK_POSITION_UNKNOWN 0xFF
+#define SLINK_HIT_SIZE 3
+#define SLINK_FEATURES_SIZE 7
+
+// CRC-8, polynomial x^8 + x^2 + x + 1 (0x07), initial value 0
+static inline uint8_t slink_crc8_update(uint8_t crc, uint8_t b) {
+    crc ^= b;
+    for (int i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    return crc;
+}
+
+static inline uint8_t slink_crc8(const uint8_t *data, int len) {
+    uint8_t crc = 0;
+    for (int i = 0; i < len; i++) crc = slink_crc8_update(crc, data[i]);
+    return crc;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Encoder
+
+// Writes a complete frame into buf (at least SLINK_MAX_FRAME bytes).
+// Returns the number of bytes to send, or 0 if the payload is too large.
+static inline int slink_encode(uint8_t *buf, uint8_t seq, uint8_t type, const uint8_t *payload, int len) {
+    if (len < 0 || len > SLINK_MAX_PAYLOAD) return 0;
+    buf[0] = SLINK_SYNC;
+    buf[1] = (uint8_t)len;
+    buf[2] = seq;
+    buf[3] = type;
+    for (int i = 0; i < len; i++) buf[SLINK_HEADER_SIZE + i] = payload[i];
+    buf[SLINK_HEADER_SIZE + len] = slink_crc8(&buf[1], SLINK_HEADER_SIZE - 1 + len);
+    return SLINK_HEADER_SIZE + len + 1;
+}
+
+static inline int slink_put_u16(uint8_t *payload, int len, uint16_t v) {
+    payload[len]     = (uint8_t)v;
+    payload[len + 1] = (uint8_t)(v >> 8);
+    return len + 2;
+}
+
+static inline int slink_put_u32(uint8_t *payload, int len, uint32_t v) {
+    len = slink_put_u16(payload, len, (uint16_t)v);
+    return slink_put_u16(payload, len, (uint16_t)(v >> 16));
+}
+
+static inline uint16_t slink_get_u16(const uint8_t *payload) {
+    return (uint16_t)(payload[0] | (payload[1] << 8));
+}
+
+static inline uint32_t slink_get_u32(const uint8_t *payload) {
+    return slink_get_u16(payload) | ((uint32_t)slink_get_u16(payload + 2) << 16);
+}
+
+// Builds a STATES payload from a bitset of numChannels trigger states, returns payload length
+static inline int slink_build_states(uint8_t *payload, const uint8_t *bits, int numChannels) {
+    int numBytes = (numChannels + 7) / 8;
+    payload[0] = (uint8_t)numChannels;
+    for (int i = 0; i < numBytes; i++) payload[1 + i] = bits[i];
+    return 1 + numBytes;
+}
+
+// Starts a STATES payload with all numChannels off, returns payload length
+// (the bitset is then updated word by word with slink_states_put_word())
+static inline int slink_init_states(uint8_t *payload, int numChannels) {
+    int numBytes = (numChannels + 7) / 8;
+    payload[0] = (uint8_t)numChannels;
+    for (int i = 0; i < numBytes; i++) payload[1 + i] = 0;
+    return 1 + numBytes;
+}
+
+// Writes word w of a 32 bit channel bitset into a STATES payload (only the bytes of this word are touched)
+static inline void slink_states_put_word(uint8_t *payload, int w, uint32_t word) {
+    int numBytes = (payload[0] + 7) / 8;
+    for (int b = 0; b < 4 && w * 4 + b < numBytes; b++) payload[1 + w * 4 + b] = (uint8_t)(word >> (8 * b));
+}
+
+// Appends one hit to a HITS payload, returns the new payload length
+static inline int slink_add_hit(uint8_t *payload, int len, uint8_t channel, uint8_t velocity, uint8_t position) {
+    if (len + SLINK_HIT_SIZE > SLINK_MAX_PAYLOAD) return len;
+    payload[len]     = channel;
+    payload[len + 1] = velocity;
+    payload[len + 2] = position;
+    return len + SLINK_HIT_SIZE;
+}
+
+// Appends the features of one completed hit to a FEATURES payload, returns the new payload length
+static inline int slink_add_features(uint8_t *payload, int len, uint8_t channel, uint16_t peak, uint16_t riseTime, uint16_t energy) {
+    if (len + SLINK_FEATURES_SIZE > SLINK_MAX_PAYLOAD) return len;
+    payload[len] = channel;
+    len = slink_put_u16(payload, len + 1, peak);
+    len = slink_put_u16(payload, len, riseTime);
+    return slink_put_u16(payload, len, energy);
+}
+
+// Appends the delta-encoded envelope of one channel to an ENVELOPE payload (payload[0] must hold n).
+// Deltas are taken from the reconstructed values, so saturation errors do not accumulate.
+// Returns the new payload length (unchanged if the entry does not fit).
+static inline int slink_add_envelope(uint8_t *payload, int len, uint8_t channel, const uint8_t *samples, int n) {
+    if (len + 1 + n > SLINK_MAX_PAYLOAD) return len;
+    payload[len++] = channel;
+    payload[len++] = samples[0];
+    int value = samples[0];
+    for (int i = 1; i < n; i++) {
+        int delta = samples[i] - value;
+        if (delta > 127) delta = 127;
+        if (delta < -128) delta = -128;
+        value += delta;
+        payload[len++] = (uint8_t)(int8_t)delta;
+    }
+    return len;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+#define SLINK_WAIT_SYNC  0
+#define SLINK_WAIT_LEN   1
+#define SLINK_WAIT_SEQ   2
+#define SLINK_WAIT_TYPE  3
+#define SLINK_PAYLOAD    4
+#define SLINK_WAIT_CRC   5
+
+typedef struct {
+    // parser state
+    uint8_t state;
+    uint8_t len, seq, type, crc;
+    uint8_t pos;
+    uint8_t payload[SLINK_MAX_PAYLOAD];
+    // sequence tracking
+    uint8_t lastSeq;
+    uint8_t seqValid;
+    // statistics
+    uint32_t frames;       // valid frames
+    uint32_t crcErrors;    // frames dropped because of a CRC mismatch
+    uint32_t syncErrors;   // bytes skipped while searching for SYNC, or invalid length
+    uint32_t lostFrames;   // frames missing according to the sequence number
+} SlinkParser;
+
+static inline void slink_parser_init(SlinkParser *p) {
+    p->state = SLINK_WAIT_SYNC;
+    p->len = p->seq = p->type = p->crc = p->pos = 0;
+    p->lastSeq = 0;
+    p->seqValid = 0;
+    p->frames = p->crcErrors = p->syncErrors = p->lostFrames = 0;
+}
+
+// Feeds one received byte into the parser.
+// Returns 1 when a complete and valid frame is available in p->type, p->seq, p->len and p->payload
+// (valid until the next call), 0 otherwise. Corrupted frames are dropped and the parser resyncs.
+static inline int slink_parser_feed(SlinkParser *p, uint8_t b) {
+    switch (p->state) {
+        case SLINK_WAIT_SYNC:
+            if (b == SLINK_SYNC) p->state = SLINK_WAIT_LEN;
+            else p->syncErrors++;
+            return 0;
+
+        case SLINK_WAIT_LEN:
+            if (b > SLINK_MAX_PAYLOAD) {
+                p->syncErrors++;
+                p->state = (b == SLINK_SYNC) ? SLINK_WAIT_LEN : SLINK_WAIT_SYNC;
+                return 0;
+            }
+            p->len = b;
+            p->crc = slink_crc8_update(0, b);
+            p->state = SLINK_WAIT_SEQ;
+            return 0;
+
+        case SLINK_WAIT_SEQ:
+            p->seq = b;
+            p->crc = slink_crc8_update(p->crc, b);
+            p->state = SLINK_WAIT_TYPE;
+            return 0;
+
+        case SLINK_WAIT_TYPE:
+            p->type = b;
+            p->crc = slink_crc8_update(p->crc, b);
+            p->pos = 0;
+            p->state = p->len ? SLINK_PAYLOAD : SLINK_WAIT_CRC;
+            return 0;
+
+        case SLINK_PAYLOAD:
+            p->payload[p->pos++] = b;
+            p->crc = slink_crc8_update(p->crc, b);
+            if (p->pos >= p->len) p->state = SLINK_WAIT_CRC;
+            return 0;
+
+        case SLINK_WAIT_CRC:
+        default:
+            p->state = SLINK_WAIT_SYNC;
+            if (b != p->crc) {
+                p->crcErrors++;
+                return 0;
+            }
+            if (p->seqValid) p->lostFrames += (uint8_t)(p->seq - p->lastSeq - 1);
+            p->lastSeq = p->seq;
+            p->seqValid = 1;
+            p->frames++;
+            return 1;
+    }
+}
+
+// Helpers for reading decoded payloads
+
+static inline int slink_states_channels(const SlinkParser *p) {
+    if (p->len < 1) return 0;
+    int n = p->payload[0];
+    if (n > SLINK_MAX_CHANNELS) n = SLINK_MAX_CHANNELS;
+    if (n > (p->len - 1) * 8) n = (p->len - 1) * 8;   // never read beyond the received bitset
+    return n;
+}
+
+// Time in microseconds between the oldest reported change and sending the frame (SLINK_AGE_UNKNOWN if not sent)
+static inline uint16_t slink_states_age(const SlinkParser *p) {
+    int offset = 1 + (p->payload[0] + 7) / 8;
+    if (p->len < offset + 2) return SLINK_AGE_UNKNOWN;
+    return slink_get_u16(&p->payload[offset]);
+}
+
+// Sensor micros() when the oldest reported change was detected, returns 0 if the frame has no timestamp
+static inline int slink_states_timestamp(const SlinkParser *p, uint32_t *timestamp) {
+    int offset = 1 + (p->payload[0] + 7) / 8 + 2;
+    if (p->len < offset + 4) return 0;
+    *timestamp = slink_get_u32(&p->payload[offset]);
+    return 1;
+}
+
+static inline int slink_states_bit(const SlinkParser *p, int channel) {
+    return (p->payload[1 + (channel >> 3)] >> (channel & 7)) & 1;
+}
+
+// Number of channel entries in an ENVELOPE frame
+static inline int slink_envelope_count(const SlinkParser *p) {
+    if (p->len < 1 || p->payload[0] == 0) return 0;
+    return (p->len - 1) / (1 + p->payload[0]);
+}
+
+// Decodes entry i of an ENVELOPE frame into samples (payload[0] values), returns the channel
+static inline int slink_envelope_decode(const SlinkParser *p, int i, uint8_t *samples) {
+    int n = p->payload[0];
+    const uint8_t *entry = &p->payload[1 + i * (1 + n)];
+    int value = entry[1];
+    samples[0] = (uint8_t)value;
+    for (int k = 1; k < n; k++) {
+        value += (int8_t)entry[1 + k];
+        samples[k] = (uint8_t)value;   // stays within 0..255 by construction of the encoder
+    }
+    return entry[0];
+}
+
+static inline int slink_hits_count(const SlinkParser *p) {
+    return p->len / SLINK_HIT_SIZE;
+}
+
+static inline int slink_features_count(const SlinkParser *p) {
+    return p->len / SLINK_FEATURES_SIZE;
+}
+
+#endif
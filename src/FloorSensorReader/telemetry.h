@@ -0,0 +1,95 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Compact binary debug/telemetry records for the USB Serial port of both firmwares.
+    Records are written into a ring buffer (cheap, never blocks) and flushed opportunistically
+    when the USB Serial port has room (see tlm_flush_chunk()). If the host does not read,
+    records are dropped and counted instead of stalling the loop.
+    Use tools/telemetry_decode.py to convert the stream into CSV or a Serial Plotter feed.
+    Text output (e.g. the once per second status lines) may be interleaved, the decoder
+    finds the records by their sync byte and checksum.
+
+    Record layout (16 bytes, little endian):
+      SYNC (0xA7) | TYPE | ID | CHECK | TIMESTAMP (u32, micros) | V0 | V1 | V2 | V3 (s16 each)
+    CHECK is chosen so that the XOR over all 16 bytes is 0.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TLM_SYNC         0xA7
+#define TLM_RECORD_SIZE  16
+#define TLM_BUFFER_SIZE  2048   // bytes, power of two and multiple of TLM_RECORD_SIZE
+
+// Record types                  ID        V0         V1          V2            V3
+#define TLM_CHANNEL_TRACE  0x01  // channel   signal     baseline    trigger       sensor value
+#define TLM_TRIGGER        0x02  // player    trigger    note        y position    velocity
+#define TLM_RELEASE        0x03  // player    trigger    note        -             -
+#define TLM_BIGWAVE        0x04  // player    partner    note        -             -
+#define TLM_PERFORMANCE    0x05  // -         fps        free kB     dropped recs  MIDI voices
+#define TLM_MODE           0x06  // tonescale mode       -           -             -
+#define TLM_RAW_SCAN       0x07  // 1st chan. raw[id]   raw[id+1]   raw[id+2]     raw[id+3]   (timestamp = scan time)
+#define TLM_HIT_FEATURES   0x08  // player    trigger    peak        rise time us  energy
+#define TLM_CHANNEL_HEALTH 0x09  // channel*  noise rms  baseline    saturated     onsets      (per HEALTH_PERIOD, see sensorhealth.h)
+                                 // * bit 7 = muted, bit 6 = silent, noise rms in ADC units * 16
+
+typedef struct {
+    uint8_t buf[TLM_BUFFER_SIZE];
+    volatile uint16_t head, tail;
+    uint32_t dropped;   // records lost because the buffer was full
+} TelemetryBuffer;
+
+static inline void tlm_init(TelemetryBuffer *t) {
+    t->head = t->tail = 0;
+    t->dropped = 0;
+}
+
+static inline void tlm_put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+// Appends one record, returns 0 (and counts a drop) if the buffer is full
+static inline int tlm_record(TelemetryBuffer *t, uint8_t type, uint8_t id, uint32_t timestamp,
+                             int16_t v0, int16_t v1, int16_t v2, int16_t v3) {
+    uint16_t used = (uint16_t)(t->head - t->tail) & (TLM_BUFFER_SIZE - 1);
+    if (used + TLM_RECORD_SIZE >= TLM_BUFFER_SIZE) {
+        t->dropped++;
+        return 0;
+    }
+    uint8_t *r = &t->buf[t->head];   // records never wrap, TLM_BUFFER_SIZE is a multiple of the record size
+    r[0] = TLM_SYNC;
+    r[1] = type;
+    r[2] = id;
+    tlm_put_u16(&r[4], (uint16_t)timestamp);
+    tlm_put_u16(&r[6], (uint16_t)(timestamp >> 16));
+    tlm_put_u16(&r[8], (uint16_t)v0);
+    tlm_put_u16(&r[10], (uint16_t)v1);
+    tlm_put_u16(&r[12], (uint16_t)v2);
+    tlm_put_u16(&r[14], (uint16_t)v3);
+    uint8_t check = 0;
+    for (int i = 0; i < TLM_RECORD_SIZE; i++) if (i != 3) check ^= r[i];
+    r[3] = check;
+    t->head = (t->head + TLM_RECORD_SIZE) & (TLM_BUFFER_SIZE - 1);
+    return 1;
+}
+
+// Returns the number of contiguous bytes ready for sending (at most maxBytes, whole records only,
+// so other binary output can follow without splitting a record) and a pointer to them.
+// Call tlm_consume() with the number of bytes actually written.
+static inline int tlm_flush_chunk(TelemetryBuffer *t, const uint8_t **data, int maxBytes) {
+    uint16_t head = t->head, tail = t->tail;
+    int n = (head >= tail) ? head - tail : TLM_BUFFER_SIZE - tail;
+    if (n > maxBytes) n = maxBytes - maxBytes % TLM_RECORD_SIZE;
+    *data = &t->buf[tail];
+    return n;
+}
+
+static inline void tlm_consume(TelemetryBuffer *t, int n) {
+    t->tail = (t->tail + n) & (TLM_BUFFER_SIZE - 1);
+}
+
+#endif
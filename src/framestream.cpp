@@ -0,0 +1,150 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Streaming of the rendered frames via USB Serial, for external preview and capture
+    (enable with the serial command "set frame_stream <n>", see params.cpp).
+
+    Each streamed image is XOR-delta coded against the previously streamed image
+    (every FRAMESTREAM_KEYFRAME_PERIOD frames a keyframe is sent instead) and compressed
+    with a PackBits run length code, unchanged pixels thus cost almost nothing.
+    Packet: SYNC1 SYNC2 | SEQ (u16) | WIDTH | HEIGHT | FLAGS | LENGTH (u16) | RLE data | CRC-8
+    RLE data: control byte c < 128: c+1 literal bytes follow, c >= 128: next byte repeated c-126 times.
+
+    framestream_flush() only writes what fits into the USB Serial buffer. If the host is slow
+    and a packet is still pending when the next frame is due, that frame is dropped, so the
+    render loop never waits for the host. Use tools/framestream_decode.py to reassemble the images.
+    Text is printed via textOutput, which holds it back while a packet is partially sent and
+    lets framestream_flush() write it after the packet (Serial.printf would split the packet).
+*/
+
+#include <Arduino.h>
+#include "framestream.h"
+#include "FloorSensorReader/sensorlink.h"   // CRC-8
+
+#define FRAMESTREAM_IMAGE_SIZE (FRAMESTREAM_MAX_PIXELS * 3)
+#define FRAMESTREAM_PACKET_SIZE (FRAMESTREAM_HEADER_SIZE + FRAMESTREAM_IMAGE_SIZE + FRAMESTREAM_IMAGE_SIZE / 128 + 2)
+
+static uint8_t previousImage[FRAMESTREAM_IMAGE_SIZE];   // reference for the delta coding
+static uint8_t deltaImage[FRAMESTREAM_IMAGE_SIZE];
+static uint8_t packet[FRAMESTREAM_PACKET_SIZE];
+static int packetLength = 0, packetPos = 0;
+
+static uint16_t frameSeq = 0;
+static int framesToKeyframe = 0;
+static int previousWidth = 0, previousHeight = 0;
+static uint32_t framesStreamed = 0, framesDropped = 0, bytesStreamed = 0;
+
+static char heldText[FRAMESTREAM_TEXT_BUFFER];   // text printed while a packet was partially sent
+static int heldLength = 0, heldPos = 0;
+static uint32_t textDropped = 0;
+
+FrameStreamText textOutput;
+
+size_t FrameStreamText::write(const uint8_t * data, size_t size) {
+    if (heldPos >= heldLength && (packetPos == 0 || packetPos >= packetLength))
+        return Serial.write(data, size);   // no packet started: text goes out directly
+    if (heldPos == heldLength) heldPos = heldLength = 0;
+    size_t n = size;
+    if (n > (size_t)(FRAMESTREAM_TEXT_BUFFER - heldLength)) {
+        n = FRAMESTREAM_TEXT_BUFFER - heldLength;
+        textDropped += size - n;
+    }
+    memcpy(&heldText[heldLength], data, n);
+    heldLength += n;
+    return size;
+}
+
+// PackBits encoder, returns the encoded length (at most n + n / 128 + 1 bytes)
+static int encodeRLE(const uint8_t * src, int n, uint8_t * dst) {
+    int in = 0, out = 0;
+    while (in < n) {
+        int run = 1;
+        while (in + run < n && run < 129 && src[in + run] == src[in]) run++;
+        if (run >= 2) {
+            dst[out++] = (uint8_t)(run + 126);
+            dst[out++] = src[in];
+            in += run;
+            continue;
+        }
+        int literal = 1;   // collect literals until a run of two equal bytes starts
+        while (in + literal < n && literal < 128 &&
+               !(in + literal + 1 < n && src[in + literal] == src[in + literal + 1])) literal++;
+        dst[out++] = (uint8_t)(literal - 1);
+        memcpy(&dst[out], &src[in], literal);
+        out += literal;
+        in += literal;
+    }
+    return out;
+}
+
+bool framestream_submit(const uint8_t * image, int width, int height) {
+    int size = width * height * 3;
+    if (size > FRAMESTREAM_IMAGE_SIZE || width > 255 || height > 255) return false;
+    if (packetPos < packetLength) {
+        framesDropped++;
+        return false;
+    }
+
+    bool keyframe = (framesToKeyframe == 0 || width != previousWidth || height != previousHeight);
+    const uint8_t * data = image;
+    if (!keyframe) {
+        for (int i = 0; i < size; i++) deltaImage[i] = image[i] ^ previousImage[i];
+        data = deltaImage;
+    }
+    memcpy(previousImage, image, size);
+    previousWidth = width;
+    previousHeight = height;
+    framesToKeyframe = keyframe ? FRAMESTREAM_KEYFRAME_PERIOD - 1 : framesToKeyframe - 1;
+
+    int len = encodeRLE(data, size, &packet[FRAMESTREAM_HEADER_SIZE]);
+    packet[0] = FRAMESTREAM_SYNC1;
+    packet[1] = FRAMESTREAM_SYNC2;
+    packet[2] = (uint8_t)frameSeq;
+    packet[3] = (uint8_t)(frameSeq >> 8);
+    packet[4] = width;
+    packet[5] = height;
+    packet[6] = keyframe ? FRAMESTREAM_FLAG_KEYFRAME : 0;
+    packet[7] = (uint8_t)len;
+    packet[8] = (uint8_t)(len >> 8);
+    packet[FRAMESTREAM_HEADER_SIZE + len] = slink_crc8(&packet[2], FRAMESTREAM_HEADER_SIZE - 2 + len);
+    packetLength = FRAMESTREAM_HEADER_SIZE + len + 1;
+    packetPos = 0;
+    frameSeq++;
+    framesStreamed++;
+    return true;
+}
+
+// write as much of data as fits into the USB Serial buffer, returns the number of bytes written
+static int writeAvailable(const void * data, int length) {
+    int n = Serial.availableForWrite();
+    if (n > length) n = length;
+    if (n <= 0) return 0;
+    Serial.write((const uint8_t *) data, n);
+    return n;
+}
+
+bool framestream_flush() {
+    if (packetPos > 0 && packetPos < packetLength) {   // finish the started packet first
+        int n = writeAvailable(&packet[packetPos], packetLength - packetPos);
+        packetPos += n;
+        bytesStreamed += n;
+        if (packetPos < packetLength) return true;
+    }
+    if (heldPos < heldLength) {   // then the text held back meanwhile
+        heldPos += writeAvailable(&heldText[heldPos], heldLength - heldPos);
+        if (heldPos < heldLength) return true;
+    }
+    if (packetPos >= packetLength) return false;
+    int n = writeAvailable(&packet[packetPos], packetLength - packetPos);
+    packetPos += n;
+    bytesStreamed += n;
+    return packetPos < packetLength;
+}
+
+void framestream_printStats() {
+    if (!framesStreamed && !framesDropped && !textDropped) return;
+    textOutput.printf("Frame stream: %lu frames, %lu dropped, %lu bytes/s, %lu text bytes dropped\n",
+                      framesStreamed, framesDropped, bytesStreamed, textDropped);
+    framesStreamed = framesDropped = bytesStreamed = textDropped = 0;
+}
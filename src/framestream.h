@@ -0,0 +1,37 @@
+
+
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <Arduino.h>
+
+#define FRAMESTREAM_MAX_PIXELS 2000          // largest image (width * height) that can be streamed
+#define FRAMESTREAM_KEYFRAME_PERIOD 30       // every 30th streamed frame is sent without delta coding
+#define FRAMESTREAM_SYNC1 0xA9               // start of a frame packet (differs from the telemetry sync byte)
+#define FRAMESTREAM_SYNC2 0x46
+#define FRAMESTREAM_HEADER_SIZE 9            // SYNC1 SYNC2 SEQ(u16) WIDTH HEIGHT FLAGS LENGTH(u16)
+#define FRAMESTREAM_FLAG_KEYFRAME 0x01
+#define FRAMESTREAM_TEXT_BUFFER 1024         // text held back while a packet is partially sent (bytes)
+
+// Encode an RGB image (width * height * 3 bytes, rows from top to bottom) into a frame packet.
+// Returns false (and counts a dropped frame) if the previous packet is still being sent.
+bool framestream_submit(const uint8_t * image, int width, int height);
+
+// Write the pending packet as far as the USB Serial buffer allows (non-blocking), then the held back text.
+// Returns true while a packet or held back text is only partially sent (other output must wait).
+bool framestream_flush();
+
+// Text output (status messages, statistics, shell replies) on the USB Serial port: written directly,
+// but held back while a frame packet is partially sent, so text never ends up inside a packet.
+// If more than FRAMESTREAM_TEXT_BUFFER bytes are held back, the rest is dropped (and counted).
+class FrameStreamText : public Print {
+  public:
+    virtual size_t write(uint8_t b) { return write(&b, 1); }
+    virtual size_t write(const uint8_t * data, size_t size);
+    using Print::write;
+};
+extern FrameStreamText textOutput;
+
+void framestream_printStats();
+
+#endif
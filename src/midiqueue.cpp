@@ -0,0 +1,107 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    MIDI output queue: all MIDI messages produced during one frame (players, big waves,
+    idle animation, mode and volume changes, aftertouch) are collected and written as one
+    batch by midiqueue_flush(), followed by usbMIDI.send_now(), so they leave in as few
+    USB transfers as possible and without waiting for the USB MIDI transmit timeout.
+
+    Note on/off messages have their own queue (priority lane) which is always written first,
+    so a note-on is never delayed behind control changes or aftertouch. Within the control
+    lane, a newer value of the same control (or aftertouch of the same note) replaces the
+    queued one. A full queue is flushed immediately, no message is lost.
+    The time from queueing to transmission and the number of send_now() calls are measured, the
+    number of USB transfers is estimated from the bytes per batch (the core does not report it).
+*/
+
+#include <Arduino.h>
+#include "midiqueue.h"
+#include "framestream.h"
+
+typedef struct {
+    uint8_t type;                            // usbMIDI.NoteOn, NoteOff, ControlChange or AfterTouchPoly
+    uint8_t data1, data2, channel;
+    uint32_t time;                           // micros() when queued
+} MidiMessage;
+
+static MidiMessage noteQueue[MIDIQUEUE_NOTE_SIZE];
+static MidiMessage controlQueue[MIDIQUEUE_CONTROL_SIZE];
+static int noteCount = 0, controlCount = 0;
+
+static uint32_t messagesSent = 0, batchesSent = 0, transfersSent = 0, messagesReplaced = 0, queueFull = 0;
+static uint32_t latencySum = 0, latencyMax = 0;
+
+static void sendMessage(const MidiMessage * m, uint32_t now) {
+    switch (m->type) {
+        case usbMIDI.NoteOn:         usbMIDI.sendNoteOn(m->data1, m->data2, m->channel); break;
+        case usbMIDI.NoteOff:        usbMIDI.sendNoteOff(m->data1, m->data2, m->channel); break;
+        case usbMIDI.ControlChange:  usbMIDI.sendControlChange(m->data1, m->data2, m->channel); break;
+        case usbMIDI.AfterTouchPoly: usbMIDI.sendAfterTouchPoly(m->data1, m->data2, m->channel); break;
+    }
+    uint32_t latency = now - m->time;
+    latencySum += latency;
+    if (latency > latencyMax) latencyMax = latency;
+}
+
+static void queueNote(uint8_t type, uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (noteCount == MIDIQUEUE_NOTE_SIZE) {
+        queueFull++;
+        midiqueue_flush();
+    }
+    noteQueue[noteCount++] = { type, note, velocity, channel, micros() };
+}
+
+static void queueControl(uint8_t type, uint8_t data1, uint8_t data2, uint8_t channel) {
+    for (int i = 0; i < controlCount; i++) {
+        MidiMessage * m = &controlQueue[i];
+        if (m->type == type && m->data1 == data1 && m->channel == channel) {   // only the latest value counts
+            m->data2 = data2;
+            messagesReplaced++;
+            return;
+        }
+    }
+    if (controlCount == MIDIQUEUE_CONTROL_SIZE) {
+        queueFull++;
+        midiqueue_flush();
+    }
+    controlQueue[controlCount++] = { type, data1, data2, channel, micros() };
+}
+
+void midiqueue_noteOn(uint8_t note, uint8_t velocity, uint8_t channel) {
+    queueNote(usbMIDI.NoteOn, note, velocity, channel);
+}
+
+void midiqueue_noteOff(uint8_t note, uint8_t velocity, uint8_t channel) {
+    queueNote(usbMIDI.NoteOff, note, velocity, channel);
+}
+
+void midiqueue_controlChange(uint8_t control, uint8_t value, uint8_t channel) {
+    queueControl(usbMIDI.ControlChange, control, value, channel);
+}
+
+void midiqueue_afterTouchPoly(uint8_t note, uint8_t pressure, uint8_t channel) {
+    queueControl(usbMIDI.AfterTouchPoly, note, pressure, channel);
+}
+
+void midiqueue_flush() {
+    int count = noteCount + controlCount;
+    if (!count) return;
+    uint32_t now = micros();
+    for (int i = 0; i < noteCount; i++) sendMessage(&noteQueue[i], now);
+    for (int i = 0; i < controlCount; i++) sendMessage(&controlQueue[i], now);
+    usbMIDI.send_now();
+    noteCount = controlCount = 0;
+
+    messagesSent += count;
+    batchesSent++;   // one send_now() per batch
+    transfersSent += (count * MIDIQUEUE_EVENT_SIZE + MIDIQUEUE_PACKET_SIZE - 1) / MIDIQUEUE_PACKET_SIZE;
+}
+
+void midiqueue_printStats() {
+    if (!messagesSent) return;
+    textOutput.printf("MIDI: %lu messages in %lu batches (send_now), est. %lu USB transfers, %lu replaced, %lu queue full, latency avg=%luus max=%luus\n",
+                  messagesSent, batchesSent, transfersSent, messagesReplaced, queueFull, latencySum / messagesSent, latencyMax);
+    messagesSent = batchesSent = transfersSent = messagesReplaced = queueFull = 0;
+    latencySum = latencyMax = 0;
+}
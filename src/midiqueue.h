@@ -0,0 +1,24 @@
+
+
+#ifndef MIDIQUEUE_H
+#define MIDIQUEUE_H
+
+#include <Arduino.h>
+
+#define MIDIQUEUE_NOTE_SIZE 32              // note on/off messages queued per frame (priority lane)
+#define MIDIQUEUE_CONTROL_SIZE 32           // control change and aftertouch messages queued per frame
+#define MIDIQUEUE_PACKET_SIZE 512           // bytes per USB MIDI transfer (Teensy4.1 high speed, 64 at full speed)
+#define MIDIQUEUE_EVENT_SIZE 4              // bytes per USB MIDI event packet (one message)
+
+// Queue MIDI messages, they are sent with the next midiqueue_flush()
+void midiqueue_noteOn(uint8_t note, uint8_t velocity, uint8_t channel);
+void midiqueue_noteOff(uint8_t note, uint8_t velocity, uint8_t channel);
+void midiqueue_controlChange(uint8_t control, uint8_t value, uint8_t channel);   // replaces a queued value of the same control
+void midiqueue_afterTouchPoly(uint8_t note, uint8_t pressure, uint8_t channel);  // replaces a queued pressure of the same note
+
+// Write all queued messages (notes first) as one batch and transmit it immediately (usbMIDI.send_now())
+void midiqueue_flush();
+
+void midiqueue_printStats();
+
+#endif
@@ -0,0 +1,138 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Central table of the sounding MIDI notes, so no path can leave a note hanging on the synth
+    (a hanging note keeps a voice of the ZynAddSubFX host busy).
+
+    For every channel and note the number of voices is counted: each note-on adds a voice, the
+    note-off is only sent when the last voice is released, a note-off for a note that is not
+    active (e.g. after an all-notes-off) is dropped. The active notes of a channel are also kept
+    in a 128 bit set, so lookups are O(1) and an all-notes-off only visits the sounding notes.
+    Notes with a fixed duration get a scheduled note-off, sent by notetracker_update().
+    All messages are sent via the MIDI queue (see midiqueue.cpp).
+*/
+
+#include <Arduino.h>
+#include "notetracker.h"
+#include "midiqueue.h"
+#include "framestream.h"
+
+#define NOTETRACKER_OFF_VELOCITY 64          // release velocity of generated note-offs
+
+typedef struct {
+    uint8_t note, channel;                   // channel 0 = unused entry
+    uint32_t due;                            // millis() of the note-off
+} TimedNote;
+
+static uint8_t voices[NOTETRACKER_CHANNELS][128];
+static uint32_t activeNotes[NOTETRACKER_CHANNELS][4];   // bit note & 31 of word note >> 5
+static uint16_t channelVoices[NOTETRACKER_CHANNELS];
+static TimedNote timedNotes[NOTETRACKER_MAX_TIMED];
+static int totalVoices = 0, maxVoices = 0;
+static uint32_t strayNoteOffs = 0, forcedNoteOffs = 0, timedNoteOffs = 0;
+
+static bool validChannel(uint8_t channel) {
+    return channel >= 1 && channel <= NOTETRACKER_CHANNELS;
+}
+
+static void cancelTimed(uint8_t note, uint8_t channel) {
+    for (int i = 0; i < NOTETRACKER_MAX_TIMED; i++)
+        if (timedNotes[i].channel == channel && timedNotes[i].note == note) timedNotes[i].channel = 0;
+}
+
+// send the note-off and forget all voices of the note
+static void releaseNote(uint8_t note, uint8_t velocity, uint8_t channel) {
+    int c = channel - 1;
+    channelVoices[c] -= voices[c][note];
+    totalVoices -= voices[c][note];
+    voices[c][note] = 0;
+    activeNotes[c][note >> 5] &= ~(1UL << (note & 31));
+    cancelTimed(note, channel);
+    midiqueue_noteOff(note, velocity, channel);
+}
+
+void notetracker_noteOn(uint8_t note, uint8_t velocity, uint8_t channel, uint32_t duration) {
+    if (!validChannel(channel) || note > 127) return;
+    int c = channel - 1;
+    if (voices[c][note] < 255) {
+        voices[c][note]++;
+        channelVoices[c]++;
+        totalVoices++;
+        if (totalVoices > maxVoices) maxVoices = totalVoices;
+    }
+    activeNotes[c][note >> 5] |= 1UL << (note & 31);
+    midiqueue_noteOn(note, velocity, channel);
+
+    if (duration) {
+        int slot = -1;
+        for (int i = 0; i < NOTETRACKER_MAX_TIMED && slot < 0; i++)
+            if (!timedNotes[i].channel || (timedNotes[i].channel == channel && timedNotes[i].note == note)) slot = i;
+        if (slot < 0) {   // table full: the earliest note-off is sent now
+            slot = 0;
+            for (int i = 1; i < NOTETRACKER_MAX_TIMED; i++)
+                if ((int32_t)(timedNotes[i].due - timedNotes[slot].due) < 0) slot = i;
+            releaseNote(timedNotes[slot].note, NOTETRACKER_OFF_VELOCITY, timedNotes[slot].channel);
+            forcedNoteOffs++;
+        }
+        timedNotes[slot] = { note, channel, millis() + duration };
+    }
+}
+
+void notetracker_noteOff(uint8_t note, uint8_t velocity, uint8_t channel) {
+    if (!validChannel(channel) || note > 127) return;
+    int c = channel - 1;
+    if (!voices[c][note]) {
+        strayNoteOffs++;
+        return;
+    }
+    if (voices[c][note] > 1) {   // another voice still holds the note
+        voices[c][note]--;
+        channelVoices[c]--;
+        totalVoices--;
+        return;
+    }
+    releaseNote(note, velocity, channel);
+}
+
+bool notetracker_isActive(uint8_t note, uint8_t channel) {
+    if (!validChannel(channel) || note > 127) return false;
+    return voices[channel - 1][note] != 0;
+}
+
+int notetracker_voices(uint8_t channel) {
+    if (!channel) return totalVoices;
+    return validChannel(channel) ? channelVoices[channel - 1] : 0;
+}
+
+void notetracker_channelOff(uint8_t channel) {
+    if (!validChannel(channel) || !channelVoices[channel - 1]) return;
+    for (int w = 0; w < 4; w++) {
+        uint32_t notes = activeNotes[channel - 1][w];
+        for (; notes; notes &= notes - 1) {
+            releaseNote(w * 32 + __builtin_ctz(notes), NOTETRACKER_OFF_VELOCITY, channel);
+            forcedNoteOffs++;
+        }
+    }
+}
+
+void notetracker_allNotesOff() {
+    for (int channel = 1; channel <= NOTETRACKER_CHANNELS; channel++) notetracker_channelOff(channel);
+}
+
+void notetracker_update(uint32_t now) {
+    for (int i = 0; i < NOTETRACKER_MAX_TIMED; i++) {
+        TimedNote * t = &timedNotes[i];
+        if (!t->channel || (int32_t)(now - t->due) < 0) continue;
+        releaseNote(t->note, NOTETRACKER_OFF_VELOCITY, t->channel);   // also clears the entry
+        timedNoteOffs++;
+    }
+}
+
+void notetracker_printStats() {
+    if (!totalVoices && !maxVoices && !timedNoteOffs && !forcedNoteOffs && !strayNoteOffs) return;
+    textOutput.printf("Notes: %d voices (max %d), %lu scheduled, %lu forced and %lu stray note-offs\n",
+                  totalVoices, maxVoices, timedNoteOffs, forcedNoteOffs, strayNoteOffs);
+    maxVoices = totalVoices;
+    timedNoteOffs = forcedNoteOffs = strayNoteOffs = 0;
+}
@@ -0,0 +1,29 @@
+
+
+#ifndef NOTETRACKER_H
+#define NOTETRACKER_H
+
+#include <Arduino.h>
+
+#define NOTETRACKER_CHANNELS 16             // MIDI channels 1 .. 16
+#define NOTETRACKER_MAX_TIMED 16            // notes with a scheduled note-off at the same time
+
+// Start a note (sent via the MIDI queue), with duration > 0 (ms) the note-off is sent automatically
+void notetracker_noteOn(uint8_t note, uint8_t velocity, uint8_t channel, uint32_t duration = 0);
+
+// Release one voice of a note, the note-off is sent when the last voice is released (ignored if the note is not active)
+void notetracker_noteOff(uint8_t note, uint8_t velocity, uint8_t channel);
+
+bool notetracker_isActive(uint8_t note, uint8_t channel);
+int notetracker_voices(uint8_t channel);   // active voices of a channel, 0 = all channels
+
+// Note-offs for all active notes of a channel / of all channels
+void notetracker_channelOff(uint8_t channel);
+void notetracker_allNotesOff();
+
+// Send the scheduled note-offs which are due (call once per frame)
+void notetracker_update(uint32_t now);
+
+void notetracker_printStats();
+
+#endif
@@ -0,0 +1,218 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Parameter registry and serial command shell for tuning the installation on site
+    (without reflashing). Commands are read line by line from the USB Serial port:
+
+      list                 show all parameters with value and range
+      get <name>           show one parameter
+      set <name> <value>   change a parameter (names as the #defines in wavefx.h, case insensitive)
+      save                 store the current parameters in the EEPROM
+      load                 load the stored parameters
+      defaults             restore the defaults from wavefx.h (use save to make them permanent)
+
+    super_sample is runtime only (2 and 4 may run out of RAM with the full matrix, a stored value
+    would crash every boot), it always starts with SUPER_SAMPLE_FACTOR. Holding the mode button
+    during power-up skips the stored parameters (recovery from a bad setting without reflashing).
+
+    params_poll() is called by wavefx_loop() before a frame is rendered and returns which
+    parameter groups were modified, so that the changes are applied at the frame boundary.
+*/
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "params.h"
+#include "wavefx.h"
+#include "framestream.h"
+
+Params params;
+
+enum ParamType { PARAM_INT, PARAM_FLOAT };
+
+// Registry entry: name, type, address of the value, valid range and the group to be applied after a change
+struct ParamInfo {
+    const char * name;
+    ParamType type;
+    void * value;
+    float minValue;
+    float maxValue;
+    uint8_t apply;
+};
+
+static const ParamInfo paramInfo[] = {
+    { "wave_speed_lower",           PARAM_FLOAT, &params.waveSpeedLower,          0.001f, 0.2f,  PARAMS_APPLY_WAVE },
+    { "wave_speed_upper",           PARAM_FLOAT, &params.waveSpeedUpper,          0.001f, 0.2f,  PARAMS_APPLY_WAVE },
+    { "wave_damping_lower_trigger", PARAM_FLOAT, &params.waveDampingLowerTrigger, 0.0f,   20.0f, PARAMS_APPLY_WAVE },
+    { "wave_damping_upper_trigger", PARAM_FLOAT, &params.waveDampingUpperTrigger, 0.0f,   20.0f, PARAMS_APPLY_WAVE },
+    { "wave_damping_lower_release", PARAM_FLOAT, &params.waveDampingLowerRelease, 0.0f,   20.0f, PARAMS_APPLY_WAVE },
+    { "wave_damping_upper_release", PARAM_FLOAT, &params.waveDampingUpperRelease, 0.0f,   20.0f, PARAMS_APPLY_WAVE },
+    { "blur_amount_lower",          PARAM_INT,   &params.blurAmountLower,         0,      255,   PARAMS_APPLY_BLUR },
+    { "blur_amount_upper",          PARAM_INT,   &params.blurAmountUpper,         0,      255,   PARAMS_APPLY_BLUR },
+    { "blur_passes_lower",          PARAM_INT,   &params.blurPassesLower,         0,      4,     PARAMS_APPLY_BLUR },
+    { "blur_passes_upper",          PARAM_INT,   &params.blurPassesUpper,         0,      4,     PARAMS_APPLY_BLUR },
+    { "super_sample",               PARAM_INT,   &params.superSample,             1,      4,     PARAMS_APPLY_SUPERSAMPLE },   // not stored
+    { "target_fps",                 PARAM_INT,   &params.targetFps,               0,      1000,  PARAMS_APPLY_FPS },
+    { "brightness",                 PARAM_INT,   &params.brightness,              0,      255,   PARAMS_APPLY_BRIGHTNESS },
+    { "frame_stream",               PARAM_INT,   &params.frameStream,             0,      100,   PARAMS_APPLY_STREAM },
+    { "frame_scale",                PARAM_INT,   &params.frameScale,              1,      2,     PARAMS_APPLY_STREAM },
+};
+
+#define NUM_PARAMS (sizeof(paramInfo) / sizeof(paramInfo[0]))
+
+// Layout of the parameters in the EEPROM
+struct StoredParams {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t size;
+    Params values;
+    uint8_t checksum;
+};
+
+static char commandLine[PARAMS_LINE_LENGTH];
+static int commandLength = 0;
+
+static void setDefaults() {
+    params.waveSpeedLower = WAVE_SPEED_LOWER;
+    params.waveSpeedUpper = WAVE_SPEED_UPPER;
+    params.waveDampingLowerTrigger = WAVE_DAMPING_LOWER_TRIGGER;
+    params.waveDampingUpperTrigger = WAVE_DAMPING_UPPER_TRIGGER;
+    params.waveDampingLowerRelease = WAVE_DAMPING_LOWER_RELEASE;
+    params.waveDampingUpperRelease = WAVE_DAMPING_UPPER_RELEASE;
+    params.blurAmountLower = BLUR_AMOUNT_LOWER;
+    params.blurAmountUpper = BLUR_AMOUNT_UPPER;
+    params.blurPassesLower = BLUR_PASSES_LOWER;
+    params.blurPassesUpper = BLUR_PASSES_UPPER;
+    params.superSample = SUPER_SAMPLE_FACTOR;
+    params.targetFps = TARGET_FPS;
+    params.brightness = MAXIMUM_BRIGHTNESS;
+    params.frameStream = FRAME_STREAM_DIVIDER;
+    params.frameScale = FRAME_STREAM_SCALE;
+}
+
+static uint8_t checksum(const Params & p) {
+    const uint8_t * data = (const uint8_t *) &p;
+    uint8_t sum = 0;
+    for (unsigned int i = 0; i < sizeof(Params); i++) sum = (sum << 1 | sum >> 7) ^ data[i];
+    return sum;
+}
+
+static bool loadParams() {
+    StoredParams stored;
+    EEPROM.get(PARAMS_EEPROM_ADDRESS, stored);
+    if (stored.magic != PARAMS_MAGIC || stored.version != PARAMS_VERSION ||
+        stored.size != sizeof(Params) || stored.checksum != checksum(stored.values)) return false;
+    int superSample = params.superSample;   // runtime only, see above
+    params = stored.values;
+    params.superSample = superSample;
+    return true;
+}
+
+static void saveParams() {
+    StoredParams stored;
+    stored.magic = PARAMS_MAGIC;
+    stored.version = PARAMS_VERSION;
+    stored.size = sizeof(Params);
+    stored.values = params;
+    stored.values.superSample = SUPER_SAMPLE_FACTOR;
+    stored.checksum = checksum(stored.values);
+    EEPROM.put(PARAMS_EEPROM_ADDRESS, stored);   // only changed bytes are written
+}
+
+static const ParamInfo * findParam(const char * name) {
+    for (unsigned int i = 0; i < NUM_PARAMS; i++)
+        if (strcasecmp(paramInfo[i].name, name) == 0) return &paramInfo[i];
+    return nullptr;
+}
+
+static void printParam(const ParamInfo * p) {
+    if (p->type == PARAM_FLOAT)
+        textOutput.printf("%s = %.4f (%.3f .. %.3f)\n", p->name, *(float *) p->value, p->minValue, p->maxValue);
+    else
+        textOutput.printf("%s = %d (%d .. %d)\n", p->name, *(int *) p->value, (int) p->minValue, (int) p->maxValue);
+}
+
+// Change a parameter, returns its PARAMS_APPLY_* flag or 0 if the value is not valid
+// (the whole text has to be a number, integer parameters accept no fraction)
+static uint8_t setParam(const ParamInfo * p, const char * text) {
+    char * end;
+    bool valid;
+    float value = 0;
+    long intValue = 0;
+    if (p->type == PARAM_FLOAT) {
+        value = strtof(text, &end);
+        valid = end != text && *end == 0 && value >= p->minValue && value <= p->maxValue;
+    } else {
+        intValue = strtol(text, &end, 10);
+        valid = end != text && *end == 0 && intValue >= p->minValue && intValue <= p->maxValue;
+        if (p->value == &params.superSample && (intValue & (intValue - 1))) valid = false;   // only 1, 2 or 4
+    }
+    if (!valid) {
+        textOutput.printf("invalid value for %s\n", p->name);
+        return 0;
+    }
+    if (p->type == PARAM_FLOAT) *(float *) p->value = value;
+    else *(int *) p->value = (int) intValue;
+    printParam(p);
+    return p->apply;
+}
+
+static uint8_t executeCommand(char * line) {
+    char * command = strtok(line, " \t");
+    char * name = strtok(nullptr, " \t");
+    char * value = strtok(nullptr, " \t");
+    if (!command) return 0;
+
+    if (!strcasecmp(command, "list")) {
+        for (unsigned int i = 0; i < NUM_PARAMS; i++) printParam(&paramInfo[i]);
+    }
+    else if (!strcasecmp(command, "get") || !strcasecmp(command, "set")) {
+        const ParamInfo * p = name ? findParam(name) : nullptr;
+        if (!p) textOutput.printf("unknown parameter, use list\n");
+        else if (!strcasecmp(command, "get")) printParam(p);
+        else if (!value) textOutput.printf("usage: set <name> <value>\n");
+        else return setParam(p, value);
+    }
+    else if (!strcasecmp(command, "save")) {
+        saveParams();
+        textOutput.printf("parameters saved\n");
+    }
+    else if (!strcasecmp(command, "load")) {
+        if (!loadParams()) textOutput.printf("no valid parameters stored\n");
+        else {
+            textOutput.printf("parameters loaded\n");
+            return 0xff;
+        }
+    }
+    else if (!strcasecmp(command, "defaults")) {
+        setDefaults();
+        textOutput.printf("default parameters restored\n");
+        return 0xff;
+    }
+    else {
+        textOutput.printf("commands: list, get <name>, set <name> <value>, save, load, defaults\n");
+    }
+    return 0;
+}
+
+void params_setup() {
+    setDefaults();
+    if (digitalRead(MODE_PIN) == LOW) textOutput.printf("Mode button held: stored parameters ignored\n");
+    else if (loadParams()) textOutput.printf("Parameters loaded from EEPROM\n");
+}
+
+uint8_t params_poll() {
+    uint8_t changes = 0;
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == '\r' || c == '\n') {
+            commandLine[commandLength] = 0;
+            if (commandLength) changes |= executeCommand(commandLine);
+            commandLength = 0;
+        }
+        else if (commandLength < PARAMS_LINE_LENGTH - 1) {
+            commandLine[commandLength++] = c;
+        }
+    }
+    return changes;
+}
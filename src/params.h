@@ -0,0 +1,45 @@
+
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <Arduino.h>
+
+#define PARAMS_EEPROM_ADDRESS 0      // start address of the stored parameters in the (emulated) EEPROM
+#define PARAMS_MAGIC 0x4B50          // marks valid stored parameters
+#define PARAMS_VERSION 2             // increase when struct Params changes, stored parameters are then ignored
+#define PARAMS_LINE_LENGTH 64        // maximum length of a command line
+
+// Flags returned by params_poll(): which group of parameters was modified
+#define PARAMS_APPLY_WAVE        0x01   // wave speed and damping
+#define PARAMS_APPLY_BLUR        0x02   // blur amount and passes
+#define PARAMS_APPLY_SUPERSAMPLE 0x04   // super sampling factor
+#define PARAMS_APPLY_BRIGHTNESS  0x08
+#define PARAMS_APPLY_FPS         0x10
+#define PARAMS_APPLY_STREAM      0x20   // frame streaming via USB Serial
+
+// Parameters that can be tuned at runtime (defaults from wavefx.h)
+struct Params {
+    float waveSpeedLower;
+    float waveSpeedUpper;
+    float waveDampingLowerTrigger;
+    float waveDampingUpperTrigger;
+    float waveDampingLowerRelease;
+    float waveDampingUpperRelease;
+    int blurAmountLower;
+    int blurAmountUpper;
+    int blurPassesLower;
+    int blurPassesUpper;
+    int superSample;   // super sampling factor: 1, 2 or 4 (runtime only, not stored)
+    int targetFps;     // 0 = unlimited
+    int brightness;
+    int frameStream;   // stream every n-th frame via USB Serial (0 = off), see framestream.h
+    int frameScale;    // downscaling of the streamed frames: 1 or 2
+};
+
+extern Params params;
+
+void params_setup();   // set the defaults and load stored parameters from EEPROM (if valid and the mode button is not held)
+uint8_t params_poll(); // handle commands from the USB Serial port (non-blocking), returns PARAMS_APPLY_* flags of modified parameters
+
+#endif
@@ -0,0 +1,369 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Receiver for the links from the FloorSensorReader boards.
+    Each board is connected to its own hardware UART (see boardPorts, Serial1 for the first board).
+    The UARTs are filled by interrupts into ring buffers (enlarged with addMemoryForRead),
+    sensorinput_poll() feeds the available bytes into one incremental frame parser per board
+    without blocking, and decoded frames are published as SensorEvents (with board id and
+    the micros() of the poll which decoded them) into one merged event queue.
+    When no bytes are pending, a poll costs a single available() call per board.
+
+    The link starts at SLINK_DEFAULT_BAUD and switches to the baud rate requested by the
+    sensor board (up to SENSORINPUT_MAX_BAUD), see sensorlink.h for the negotiation.
+    Throughput and latency counters are printed with the debug output:
+    link latency = age of the change at the sensor board + transmission time of the frame,
+    poll gap = longest time between two polls (the bytes wait in the UART ring buffer up to this
+    long, e.g. during a render), backlog = most bytes pending at one poll,
+    consume delay = time from the poll until the event is consumed by wavefx_loop().
+
+    Clock sync: every SENSORINPUT_SYNC_PERIOD a PING is sent, the PONG contains the sensor time
+    at reception. offset sample = sensor reception time - (PING send time + transmission time),
+    so the slow loop on the Teensy side does not affect the estimate (the sensor side reads
+    Serial1 once per sampling period, which limits the accuracy to about one period).
+    Offset and drift are tracked with a simple second order filter; source timestamps
+    of STATES frames are converted into the micros() domain of the Teensy.
+
+    Link health: the sensor board sends a HEARTBEAT from its sampling loop every
+    SLINK_HEARTBEAT_PERIOD. If no heartbeat arrives for SENSORINPUT_HEARTBEAT_TIMEOUT,
+    the link is considered down, all active channels are released (STATE off events)
+    and sensorinput_linkHealthy() returns false, so the local buttons take over.
+
+    Envelope samples (ENVELOPE frames) are not queued as events, they are decoded directly
+    into a small ring buffer per board channel (see sensorinput_getEnvelope()).
+    Hit features (FEATURES frames) are stored per board channel as well (see sensorinput_getHitFeatures()),
+    a SENSOR_EVENT_FEATURES event tells that new features of the channel are available.
+*/
+
+#include <Arduino.h>
+#include "sensorinput.h"
+#include "framestream.h"               // Text output (held back while a frame packet is sent)
+#include "FloorSensorReader/sensorlink.h"  // Framed protocol (shared with FloorSensorReader)
+
+// UARTs for the sensor boards (board id = index). Serial2..Serial6 share pins with
+// the LED stripes, buttons and potentiometers, so additional boards use Serial7 and Serial8.
+static HardwareSerial * const boardPorts[SENSORINPUT_MAX_BOARDS] = { &Serial1, &Serial7, &Serial8 };
+
+// State of the link to one sensor board
+struct SensorBoard {
+    HardwareSerial * port;
+    uint8_t id;
+    SlinkParser parser;
+    uint8_t channelStates[SLINK_MAX_CHANNELS / 8];  // last received trigger states, one bit per channel
+    SensorEnvelope envelopes[SENSORINPUT_MAX_CHANNELS];
+    SensorHitFeatures hitFeatures[SENSORINPUT_MAX_CHANNELS];
+
+    uint32_t linkBaud;
+    uint32_t lastFrameTime;   // millis() of the last valid frame
+    uint32_t badLinkRequests; // LINK_REQUESTs with an unsupported baud rate
+    uint8_t txSeq;
+
+    // flow accounting, reset by sensorinput_printStats()
+    uint32_t bytesReceived;
+    uint32_t latencySum, latencyCount, latencyMax;
+
+    // clock sync state: sensor time = local time + syncOffset + syncDrift * (local time - syncRef)
+    uint32_t syncOffset;
+    uint32_t syncRef;
+    float syncDrift;
+    uint32_t syncSamples, syncOutliers;
+    uint32_t lastPingTime;
+
+    // link health
+    bool linkUp;
+    uint32_t lastHeartbeatTime;
+    uint32_t linkLosses;
+    uint16_t remoteCrcErrors, remoteLostFrames;   // as reported by the sensor board
+};
+
+static uint8_t rxBuffers[SENSORINPUT_NUM_BOARDS][SENSORINPUT_RX_BUFFER_SIZE];  // extra memory for the UART receive ring buffers
+static SensorBoard boards[SENSORINPUT_NUM_BOARDS];
+static uint8_t txFrame[SLINK_MAX_FRAME];
+
+static SensorEvent eventQueue[SENSORINPUT_EVENT_QUEUE_SIZE];
+static volatile uint16_t eventHead = 0, eventTail = 0;
+static uint32_t droppedEvents = 0;
+static uint32_t consumeDelayMax = 0;
+static uint32_t lastPollTime = 0, pollGapMax = 0, backlogMax = 0;
+static uint32_t statsTime = 0;
+
+static void publishEvent(SensorBoard * board, uint32_t timestamp, uint32_t sourceTime, uint8_t type, uint8_t channel, uint8_t value, uint8_t position) {
+    uint16_t next = (eventHead + 1) & (SENSORINPUT_EVENT_QUEUE_SIZE - 1);
+    if (next == eventTail) {   // queue full: drop the event rather than block
+        droppedEvents++;
+        return;
+    }
+    SensorEvent & ev = eventQueue[eventHead];
+    ev.timestamp = timestamp;
+    ev.sourceTime = sourceTime;
+    ev.board = board->id;
+    ev.type = type;
+    ev.channel = channel;
+    ev.value = value;
+    ev.position = position;
+    eventHead = next;
+}
+
+static void sendFrame(SensorBoard * board, uint8_t type, const uint8_t * payload, int len) {
+    int n = slink_encode(txFrame, board->txSeq++, type, payload, len);
+    board->port->write(txFrame, n);
+}
+
+static void sendLinkAck(SensorBoard * board, uint32_t baud) {
+    uint8_t payload[4];
+    sendFrame(board, SLINK_TYPE_LINK_ACK, payload, slink_put_u32(payload, 0, baud));
+}
+
+static void setLinkBaud(SensorBoard * board, uint32_t baud) {
+    if (baud == board->linkBaud) return;
+    board->port->flush();   // let pending bytes (e.g. the LINK_ACK) leave at the old rate
+    board->port->begin(baud);
+    board->linkBaud = baud;
+    board->lastFrameTime = millis();
+    board->parser.state = SLINK_WAIT_SYNC;
+}
+
+// Transmission time of a frame in microseconds (10 bits per byte)
+static uint32_t wireTime(SensorBoard * board, int frameLen) {
+    return (uint32_t)frameLen * 10000000UL / board->linkBaud;
+}
+
+static uint32_t currentSyncOffset(SensorBoard * board, uint32_t localTime) {
+    return board->syncOffset + (int32_t)(board->syncDrift * (float)(int32_t)(localTime - board->syncRef));
+}
+
+static void sendPing(SensorBoard * board) {
+    uint8_t payload[4];
+    board->lastPingTime = millis();
+    sendFrame(board, SLINK_TYPE_PING, payload, slink_put_u32(payload, 0, micros()));
+}
+
+static void updateClockSync(SensorBoard * board, uint32_t pingTime, uint32_t sensorReceiveTime) {
+    uint32_t sample = sensorReceiveTime - (pingTime + wireTime(board, SLINK_PING_FRAME_SIZE));
+    if (!board->syncSamples) {
+        board->syncOffset = sample;
+        board->syncRef = pingTime;
+        board->syncSamples = 1;
+        return;
+    }
+    int32_t dt = (int32_t)(pingTime - board->syncRef);
+    if (dt <= 0) return;   // stale or reordered PONG
+    uint32_t predicted = currentSyncOffset(board, pingTime);
+    int32_t error = (int32_t)(sample - predicted);
+    if (abs(error) > SENSORINPUT_SYNC_MAX_ERROR && board->syncSamples > 4) {
+        if (++board->syncOutliers < 3) return;    // ignore single outliers (e.g. delayed reception)
+        board->syncSamples = 0;                   // persistent error: sensor board was reset, start again
+        board->syncDrift = 0.0f;
+        board->syncOutliers = 0;
+        return;
+    }
+    board->syncOutliers = 0;
+    board->syncOffset = predicted + error / 4;
+    board->syncDrift += 0.1f * (float)error / (float)dt;
+    board->syncRef = pingTime;
+    board->syncSamples++;
+}
+
+// Decode a complete frame directly from the parser buffer and publish the resulting events
+static void decodeFrame(SensorBoard * board, uint32_t timestamp) {
+    SlinkParser * parser = &board->parser;
+    switch (parser->type) {
+        case SLINK_TYPE_KEYFRAME:
+            sendLinkAck(board, board->linkBaud);   // keeps the sensor board in the negotiated link mode
+            // fall through
+        case SLINK_TYPE_STATES: {
+            uint16_t age = slink_states_age(parser);
+            if (age != SLINK_AGE_UNKNOWN && parser->type == SLINK_TYPE_STATES) {
+                uint32_t latency = age + wireTime(board, SLINK_HEADER_SIZE + parser->len + 1);
+                board->latencySum += latency;
+                board->latencyCount++;
+                if (latency > board->latencyMax) board->latencyMax = latency;
+            }
+            uint32_t sourceTime = timestamp;
+            uint32_t sensorTime;
+            if (board->syncSamples > 1 && slink_states_timestamp(parser, &sensorTime))
+                sourceTime = sensorTime - currentSyncOffset(board, timestamp);
+            int numChannels = slink_states_channels(parser);
+            for (int b = 0; b < (numChannels + 7) / 8; b++) {
+                uint8_t diff = parser->payload[1 + b] ^ board->channelStates[b];
+                if (b == numChannels / 8) diff &= (1 << (numChannels & 7)) - 1;   // ignore padding bits
+                for (; diff; diff &= diff - 1) {   // only publish changes
+                    int ch = b * 8 + __builtin_ctz(diff);
+                    uint8_t state = slink_states_bit(parser, ch);
+                    board->channelStates[b] ^= 1 << (ch & 7);
+                    publishEvent(board, timestamp, sourceTime, SENSOR_EVENT_STATE, ch, state, SLINK_POSITION_UNKNOWN);
+                }
+            }
+            break;
+        }
+        case SLINK_TYPE_ENVELOPE: {
+            uint8_t samples[SLINK_MAX_PAYLOAD];
+            int n = parser->payload[0];
+            for (int i = 0; i < slink_envelope_count(parser); i++) {
+                int ch = slink_envelope_decode(parser, i, samples);
+                if (ch >= SENSORINPUT_MAX_CHANNELS) continue;
+                SensorEnvelope * env = &board->envelopes[ch];
+                for (int k = 0; k < n; k++) {
+                    env->samples[env->head] = samples[k];
+                    env->head = (env->head + 1) & (SENSORINPUT_ENVELOPE_LENGTH - 1);
+                }
+                env->updateTime = millis();
+            }
+            break;
+        }
+        case SLINK_TYPE_FEATURES:
+            for (int i = 0; i < slink_features_count(parser); i++) {
+                const uint8_t * entry = &parser->payload[i * SLINK_FEATURES_SIZE];
+                if (entry[0] >= SENSORINPUT_MAX_CHANNELS) continue;
+                SensorHitFeatures * features = &board->hitFeatures[entry[0]];
+                features->peak = slink_get_u16(&entry[1]);
+                features->riseTime = slink_get_u16(&entry[3]);
+                features->energy = slink_get_u16(&entry[5]);
+                features->time = timestamp;
+                publishEvent(board, timestamp, timestamp, SENSOR_EVENT_FEATURES, entry[0], 0, SLINK_POSITION_UNKNOWN);
+            }
+            break;
+        case SLINK_TYPE_HITS:
+            for (int i = 0; i < slink_hits_count(parser); i++) {
+                const uint8_t * hit = &parser->payload[i * SLINK_HIT_SIZE];
+                publishEvent(board, timestamp, timestamp, SENSOR_EVENT_HIT, hit[0], hit[1] & 0x7F, hit[2]);
+            }
+            break;
+        case SLINK_TYPE_LINK_REQUEST:
+            if (parser->len >= 4) {
+                uint32_t baud = slink_get_u32(parser->payload);
+                if (!slink_baud_valid(baud, SENSORINPUT_MAX_BAUD)) {   // no ACK: both sides keep the current rate
+                    board->badLinkRequests++;
+                    break;
+                }
+                sendLinkAck(board, baud);     // acknowledged at the old rate, then both sides switch
+                setLinkBaud(board, baud);
+                textOutput.printf("Sensor board %d: switching to %lu baud\n", board->id, baud);
+            }
+            break;
+        case SLINK_TYPE_HEARTBEAT:
+            board->lastHeartbeatTime = millis();
+            board->linkUp = true;
+            if (parser->len >= 4) {
+                board->remoteCrcErrors = slink_get_u16(parser->payload);
+                board->remoteLostFrames = slink_get_u16(&parser->payload[2]);
+            }
+            break;
+        case SLINK_TYPE_PONG:
+            if (parser->len >= 8) updateClockSync(board, slink_get_u32(parser->payload), slink_get_u32(&parser->payload[4]));
+            break;
+    }
+}
+
+// Heartbeats stopped: release all channels so that no note stays on, local buttons take over
+static void linkLost(SensorBoard * board, uint32_t timestamp) {
+    board->linkUp = false;
+    board->linkLosses++;
+    for (int ch = 0; ch < SLINK_MAX_CHANNELS; ch++) {
+        uint8_t mask = 1 << (ch & 7);
+        if (!(board->channelStates[ch >> 3] & mask)) continue;
+        board->channelStates[ch >> 3] &= ~mask;
+        publishEvent(board, timestamp, timestamp, SENSOR_EVENT_STATE, ch, 0, SLINK_POSITION_UNKNOWN);
+    }
+    textOutput.printf("Sensor board %d: heartbeat lost, using local buttons\n", board->id);
+}
+
+static void pollBoard(SensorBoard * board) {
+    int count = board->port->available();
+    if ((uint32_t)count > backlogMax) backlogMax = count;
+    if (count) {
+        uint32_t arrival = micros();
+        uint32_t received = millis();
+        board->bytesReceived += count;
+        while (count--) {   // only consume what is already buffered, never wait for more bytes
+            if (slink_parser_feed(&board->parser, board->port->read())) {
+                board->lastFrameTime = received;
+                decodeFrame(board, arrival);
+            }
+        }
+    }
+
+    // the timeouts are evaluated after the buffered frames were decoded, so a long frame does not drop the link
+    uint32_t now = millis();
+    if (board->linkUp && now - board->lastHeartbeatTime > SENSORINPUT_HEARTBEAT_TIMEOUT)
+        linkLost(board, micros());
+
+    // no valid frame (sensor board silent, or reset to the default rate so only garbage arrives): fall back
+    if (board->linkBaud != SLINK_DEFAULT_BAUD && now - board->lastFrameTime > SLINK_LINK_TIMEOUT) {
+        setLinkBaud(board, SLINK_DEFAULT_BAUD);   // wait for a new LINK_REQUEST
+        textOutput.printf("Sensor board %d: timeout, falling back to default baud rate\n", board->id);
+    }
+    if (now - board->lastPingTime >= SENSORINPUT_SYNC_PERIOD && now - board->lastFrameTime < SLINK_LINK_TIMEOUT)
+        sendPing(board);
+}
+
+void sensorinput_setup() {
+    for (int i = 0; i < SENSORINPUT_NUM_BOARDS; i++) {
+        SensorBoard * board = &boards[i];
+        memset(board, 0, sizeof(SensorBoard));
+        board->port = boardPorts[i];
+        board->id = i;
+        board->linkBaud = SLINK_DEFAULT_BAUD;
+        board->port->begin(SLINK_DEFAULT_BAUD);
+        board->port->addMemoryForRead(rxBuffers[i], SENSORINPUT_RX_BUFFER_SIZE);
+        slink_parser_init(&board->parser);
+    }
+}
+
+void sensorinput_poll() {
+    uint32_t now = micros();
+    if (lastPollTime && now - lastPollTime > pollGapMax) pollGapMax = now - lastPollTime;
+    lastPollTime = now;
+    for (int i = 0; i < SENSORINPUT_NUM_BOARDS; i++)
+        pollBoard(&boards[i]);
+}
+
+const SensorEnvelope * sensorinput_getEnvelope(int board, int channel) {
+    if (board < 0 || board >= SENSORINPUT_NUM_BOARDS || channel < 0 || channel >= SENSORINPUT_MAX_CHANNELS) return nullptr;
+    return &boards[board].envelopes[channel];
+}
+
+const SensorHitFeatures * sensorinput_getHitFeatures(int board, int channel) {
+    if (board < 0 || board >= SENSORINPUT_NUM_BOARDS || channel < 0 || channel >= SENSORINPUT_MAX_CHANNELS) return nullptr;
+    return &boards[board].hitFeatures[channel];
+}
+
+bool sensorinput_linkHealthy(int board) {
+    return board >= 0 && board < SENSORINPUT_NUM_BOARDS && boards[board].linkUp;
+}
+
+uint32_t sensorinput_toLocalMicros(int board, uint32_t sensorTime) {
+    return sensorTime - currentSyncOffset(&boards[board], micros());
+}
+
+bool sensorinput_getEvent(SensorEvent & ev) {
+    if (eventTail == eventHead) return false;
+    ev = eventQueue[eventTail];
+    uint32_t delay = micros() - ev.timestamp;
+    if (delay > consumeDelayMax) consumeDelayMax = delay;
+    eventTail = (eventTail + 1) & (SENSORINPUT_EVENT_QUEUE_SIZE - 1);
+    return true;
+}
+
+void sensorinput_printStats() {
+    uint32_t now = millis();
+    uint32_t interval = now - statsTime;
+    if (!interval) return;
+    for (int i = 0; i < SENSORINPUT_NUM_BOARDS; i++) {
+        SensorBoard * board = &boards[i];
+        textOutput.printf("Sensor board %d: baud=%lu, frames=%lu, crcErrors=%lu, syncErrors=%lu, lostFrames=%lu\n",
+                      i, board->linkBaud, board->parser.frames, board->parser.crcErrors, board->parser.syncErrors, board->parser.lostFrames);
+        textOutput.printf("Sensor board %d: %lu bytes/s, latency avg=%luus max=%luus\n", i, board->bytesReceived * 1000 / interval,
+                      board->latencyCount ? board->latencySum / board->latencyCount : 0, board->latencyMax);
+        textOutput.printf("Sensor board %d: %s, link losses=%lu, remote crcErrors=%u, remote lostFrames=%u, bad link requests=%lu\n",
+                      i, board->linkUp ? "up" : "down", board->linkLosses, board->remoteCrcErrors, board->remoteLostFrames, board->badLinkRequests);
+        textOutput.printf("Sensor board %d: clock offset=%ldus, drift=%dppm, sync samples=%lu\n",
+                      i, (int32_t)currentSyncOffset(board, micros()), (int)(board->syncDrift * 1000000.0f), board->syncSamples);
+        board->bytesReceived = board->latencySum = board->latencyCount = board->latencyMax = 0;
+    }
+    textOutput.printf("Sensor events: droppedEvents=%lu, poll gap max=%luus, backlog max=%lu bytes, consume delay max=%luus\n",
+                  droppedEvents, pollGapMax, backlogMax, consumeDelayMax);
+    consumeDelayMax = pollGapMax = backlogMax = 0;
+    statsTime = now;
+}
@@ -0,0 +1,66 @@
+
+#ifndef SENSORINPUT_H
+#define SENSORINPUT_H
+
+#include <Arduino.h>
+
+#define SENSORINPUT_NUM_BOARDS 1           // number of FloorSensorReader boards (Serial1, Serial7, Serial8)
+#define SENSORINPUT_MAX_BOARDS 3
+#define SENSORINPUT_MAX_CHANNELS 64        // channels per board (SLINK_MAX_CHANNELS)
+#define SENSORINPUT_RX_BUFFER_SIZE 1024   // additional memory for the interrupt-filled receive buffer of each board
+#define SENSORINPUT_EVENT_QUEUE_SIZE 64    // must be a power of two
+#define SENSORINPUT_MAX_BAUD 2000000       // highest baud rate accepted during link negotiation
+#define SENSORINPUT_HEARTBEAT_TIMEOUT 150  // link is down if no heartbeat arrives for 150 ms (3 heartbeats)
+#define SENSORINPUT_SYNC_PERIOD 250        // time in milliseconds between clock sync PINGs
+#define SENSORINPUT_SYNC_MAX_ERROR 3000    // offset samples deviating more than this (in us) are treated as outliers
+#define SENSORINPUT_ENVELOPE_LENGTH 16     // envelope samples kept per channel, must be a power of two
+
+#define SENSOR_EVENT_STATE 0   // trigger state of a channel changed (value: 1 = on, 0 = off)
+#define SENSOR_EVENT_HIT   1   // onset reported by the sensor board (value: velocity)
+#define SENSOR_EVENT_FEATURES 2   // features of a completed hit received, see sensorinput_getHitFeatures()
+
+// Event published by the sensor links, board is the index of the sensor board, timestamp is the micros() of the poll
+// that decoded it (the bytes may have waited in the receive buffer since the previous poll),
+// sourceTime is the time of detection on the sensor board converted to the local micros()
+// (equals timestamp as long as the clocks are not synchronised)
+struct SensorEvent {
+    uint32_t timestamp;
+    uint32_t sourceTime;
+    uint8_t board;
+    uint8_t type;
+    uint8_t channel;
+    uint8_t value;
+    uint8_t position;
+};
+
+// Most recent envelope samples of one sensor channel (ring buffer, head = next write position)
+struct SensorEnvelope {
+    uint8_t samples[SENSORINPUT_ENVELOPE_LENGTH];
+    uint8_t head;
+    uint32_t updateTime;   // millis() of the last received batch
+};
+
+// Features of the last completed hit of one sensor channel
+struct SensorHitFeatures {
+    uint16_t peak;       // maximum deviation from the baseline (ADC units)
+    uint16_t riseTime;   // time from the onset to the peak (us)
+    uint16_t energy;     // integrated squared deviation (see SENSOR_HIT_ENERGY_SHIFT in sensordsp.h)
+    uint32_t time;       // micros() of the reception
+};
+
+// Get the newest envelope sample, or 0 if no envelope was received for maxAge milliseconds
+inline uint8_t sensorEnvelopeLatest(const SensorEnvelope * env, uint32_t now, uint32_t maxAge) {
+    if (!env || now - env->updateTime > maxAge) return 0;
+    return env->samples[(env->head - 1) & (SENSORINPUT_ENVELOPE_LENGTH - 1)];
+}
+
+void sensorinput_setup();
+void sensorinput_poll();
+bool sensorinput_getEvent(SensorEvent & ev);
+bool sensorinput_linkHealthy(int board);
+const SensorEnvelope * sensorinput_getEnvelope(int board, int channel);
+const SensorHitFeatures * sensorinput_getHitFeatures(int board, int channel);
+uint32_t sensorinput_toLocalMicros(int board, uint32_t sensorTime);
+void sensorinput_printStats();
+
+#endif
@@ -24,14 +24,45 @@
 #include "colors&tonescales.h" // Color definitions and tone scales
 #include "pixelmap.h"  // Pixel mapping for the LED matrix
 #include "utils.h"  // Utility functions (e.g., random number generation)
+#include "sensorinput.h"  // Receiver for the sensor board links (Serial1, Serial7, Serial8)
+#include "FloorSensorReader/telemetry.h"  // Binary debug records for the USB Serial port
+#include "params.h"  // Runtime parameters and serial command shell
+#include "framestream.h"  // Streaming of the rendered frames via USB Serial
+#include "midiqueue.h"  // MIDI output batched per frame
+#include "notetracker.h"  // Active notes, guaranteed note-offs
 
 using namespace fl;        // Use the FastLED namespace for convenience
 
 // Array to hold all LED color values - one CRGB struct per LED
 CRGB leds[NUM_LEDS];
 
-uint8_t trigger1Flags, trigger2Flags = 0;  // Flags to indicate if a trigger event has occurred (received from Serial1)
-uint32_t trigger1FlagsUpdateTime = 0, trigger2FlagsUpdateTime = 0;  // Timestamps for last trigger updates (from Serial1)
+uint32_t trigger1Flags = 0, trigger2Flags = 0;  // Flags to indicate if a trigger event has occurred (received from the sensor boards), one bit per player
+uint8_t sensorVelocity[NUMBER_OF_PLAYERS * 2];  // Velocity of the last hit per trigger slot (player * 2 + trigger - 1), 0 = not reported
+uint32_t sensorOnsetTime[NUMBER_OF_PLAYERS * 2];  // Time of the last onset per trigger slot (millis, from the sensor board clock)
+
+// Mapping of sensor board channels to player triggers (trigger 1 or 2)
+struct SensorMapping {
+    uint8_t board;
+    uint8_t channel;
+    uint8_t player;
+    uint8_t trigger;
+};
+
+const SensorMapping sensorMapping[] = {
+    // board, channel, player, trigger
+    { 0, 0, 0, 1 }, { 0, 1, 0, 2 },
+    { 0, 2, 1, 1 }, { 0, 3, 1, 2 },
+    { 0, 4, 2, 1 }, { 0, 5, 2, 2 },
+    { 0, 6, 3, 1 }, { 0, 7, 3, 2 },
+    { 0, 8, 4, 1 }, { 0, 9, 4, 2 }
+};
+
+int8_t sensorSlot[SENSORINPUT_NUM_BOARDS][SENSORINPUT_MAX_CHANNELS];  // trigger slot for each board channel (-1 = unused)
+int8_t slotBoard[NUMBER_OF_PLAYERS * 2];  // sensor board for each trigger slot (-1 = only local button)
+uint8_t slotChannel[NUMBER_OF_PLAYERS * 2];  // sensor board channel for each trigger slot
+
+TelemetryBuffer telemetry;  // Debug records, written to USB Serial by flushTelemetry() when there is room
+uint8_t streamImage[NUM_LEDS * 3];  // Rectangular RGB image of the current frame for the frame stream
 
 // Create mappings between 1D array positions and 2D x,y coordinates
 XYMap xyMap = XYMap::constructWithLookUpTable(WIDTH*NUMBER_OF_PLAYERS, HEIGHT, XYTable, 0);  // For the actual LED output (may be serpentine)
@@ -54,7 +85,6 @@ WaveFx::Args CreateDefWaveArgs() {
 WaveFx bigWaveLower(xyMap, CreateDefWaveArgs());
 WaveFx bigWaveUpper(xyMap, CreateDefWaveArgs());     
 int bigwaveNote = 0;  // MIDI note for big wave effect, will be set later based on player tone scale
-uint32_t bigWaveRunTime = 0;  
 int bigWaveNoteIndex = 0;  // Index for the "travelling" big wave note in the tone scale
 bool bigWaveEnabled = 1;  // Flag to enable/disable big wave effect
 
@@ -87,6 +117,8 @@ struct PlayerData {
     int tonescaleSize = 0;
     uint32_t trigger1Timestamp = 0;  // Timestamp for the last trigger1 event
     uint32_t trigger2Timestamp = 0;  // Timestamp for the last trigger2 event
+    int trigger1YPos = 0;  // Vertical position of the last trigger1 wave
+    int trigger2YPos = 0;  // Vertical position of the last trigger2 wave
     int toneProgress = 0;  // Progress through the tone scale for this player
 
     // Constructor
@@ -114,6 +146,23 @@ PlayerData playerArray[NUMBER_OF_PLAYERS] = {
     { xyMap, CreateDefWaveArgs(), CreateDefWaveArgs(), 4, A15, 38, 37 }
 };
 
+// Queue a telemetry record (see FloorSensorReader/telemetry.h for the record types)
+void sendTelemetry(uint8_t type, uint8_t id, int16_t v0, int16_t v1 = 0, int16_t v2 = 0, int16_t v3 = 0) {
+    #ifdef CREATE_TELEMETRY_OUTPUT
+        tlm_record(&telemetry, type, id, micros(), v0, v1, v2, v3);
+    #endif
+}
+
+// Write pending telemetry records as far as the USB Serial buffer allows, never blocks the frame
+void flushTelemetry() {
+    const uint8_t * data;
+    int n = tlm_flush_chunk(&telemetry, &data, Serial.availableForWrite());
+    if (n > 0) {
+        Serial.write(data, n);
+        tlm_consume(&telemetry, n);
+    }
+}
+
 void setWaveParameters( WaveFx & waveLower, float speed, float dampening) {
     // Set the speed and dampening for one wave layer
     waveLower.setSpeed(speed);
@@ -180,7 +229,7 @@ void playIdleAnimation() {
 
                 #ifdef PLAY_IDLE_ANIM_NOTES
                 idleAnimNote = playerArray[playerId].tonescale [random(0,7)];
-                usbMIDI.sendNoteOn(idleAnimNote, MIDINOTE_VELOCITY, 8);  // Send MIDI note for idle animation
+                notetracker_noteOn(idleAnimNote, MIDINOTE_VELOCITY, IDLEANIM_MIDI_CHANNEL);  // Send MIDI note for idle animation
                 #endif
             }
 
@@ -192,7 +241,7 @@ void playIdleAnimation() {
             }
             #ifdef PLAY_IDLE_ANIM_NOTES
             if (animCounter == duration) {
-                usbMIDI.sendNoteOff(idleAnimNote, MIDINOTE_VELOCITY, 8);  // Stop the MIDI note for idle animation
+                notetracker_noteOff(idleAnimNote, MIDINOTE_VELOCITY, IDLEANIM_MIDI_CHANNEL);  // Stop the MIDI note for idle animation
                 idleAnimNote = 0;  // Reset the idle animation note
             }
             #endif
@@ -205,7 +254,6 @@ void playIdleAnimation() {
 void triggerWave(int xPos, int yPos, PlayerData * player) {
     
     int xOffset = player->playerId * WIDTH;  // Offset for the player ID to separate wave layers
-    Serial.printf("Triggering ripple at (%d, %d) for player %d\n", xPos, yPos, player->playerId);
 
     // Set a wave peak at this position in both wave layers (1.0 represents the maximum height of the wave)
     player->waveLower.setf(xPos + xOffset, yPos, TRIGGER_IMPACT_VALUE);  // Create ripple in lower layer
@@ -278,6 +326,13 @@ void applyBigWave(uint32_t now, PlayerData * player) {
     }
 }
 
+// Get the MIDI velocity for a trigger slot: use the hit velocity reported by the sensor board (if any)
+int getNoteVelocity(int slot) {
+    int velocity = sensorVelocity[slot];
+    sensorVelocity[slot] = 0;  // a reported velocity is only used for one note
+    return velocity ? velocity : MIDINOTE_VELOCITY;
+}
+
 void processPlayers(uint32_t now,PlayerData * player) {
     static int verticalPosition=0, horizontalPosition=0;
     static int triggerYValue=0;
@@ -288,12 +343,13 @@ void processPlayers(uint32_t now,PlayerData * player) {
     // handle trigger1 
 
     trigger1State = digitalRead(player->trigger1Pin);
-    if (now - trigger1FlagsUpdateTime < EXTERNAL_TRIGGER_ACTIVE_PERIOD) 
+    bool external = sensorinput_linkHealthy(slotBoard[player->playerId * 2]);  // external triggers override the buttons while the sensor board sends heartbeats
+    if (external) 
         trigger1State= trigger1Flags & (1 << (player->playerId)) ? LOW : HIGH;  // Read trigger1 state from external flags
     
     if ((trigger1State == LOW) && (player->trigger1Active == 0)) {
         lastUserActivity = now;  // Update the last user activity timestamp
-        player->trigger1Timestamp = now;  // remember the timestamp for trigger1
+        player->trigger1Timestamp = external ? sensorOnsetTime[player->playerId * 2] : now;  // remember the timestamp for trigger1
         player->trigger1Active = 1;
         horizontalPosition = WIDTH/2;
 
@@ -322,9 +378,10 @@ void processPlayers(uint32_t now,PlayerData * player) {
         }
 
         // Set wave parameters for longer wave duration  
-        setWaveParameters(player->waveLower, WAVE_SPEED_LOWER, WAVE_DAMPING_LOWER_TRIGGER);
-        setWaveParameters(player->waveUpper, WAVE_SPEED_UPPER, WAVE_DAMPING_UPPER_TRIGGER);
+        setWaveParameters(player->waveLower, params.waveSpeedLower, params.waveDampingLowerTrigger);
+        setWaveParameters(player->waveUpper, params.waveSpeedUpper, params.waveDampingUpperTrigger);
         triggerWave(horizontalPosition, verticalPosition, player);  // create a wave at the determined position
+        player->trigger1YPos = verticalPosition;
 
         for (int i=0;i<WIDTH;i++) { 
             player->waveLower.setf(xOffset+i, PLAYER_MAX_YPOS+10, 1.0);  // Create ripple in lower layer
@@ -335,27 +392,30 @@ void processPlayers(uint32_t now,PlayerData * player) {
             bigWaveUpper.addf(i*WIDTH+WIDTH/2, HEIGHT-10, 0.05);
         }
 
-        Serial.printf("Player %d trigger1 wave at position %d, mapped to note %d\n", player->playerId, verticalPosition, player->trigger1Note);
-        usbMIDI.sendNoteOn(player->trigger1Note, MIDINOTE_VELOCITY, player->midiChannel);    
+        int velocity = getNoteVelocity(player->playerId * 2);
+        sendTelemetry(TLM_TRIGGER, player->playerId, 1, player->trigger1Note, verticalPosition, velocity);
+        notetracker_noteOn(player->trigger1Note, velocity, player->midiChannel);    
     }   
     else if ((trigger1State == HIGH)  && (player->trigger1Active == 1)) {
         player->trigger1Active = 0;
         // Set wave parameters for faster wave decay
-        setWaveParameters(player->waveLower, WAVE_SPEED_LOWER, WAVE_DAMPING_LOWER_RELEASE);
-        setWaveParameters(player->waveUpper, WAVE_SPEED_UPPER, WAVE_DAMPING_UPPER_RELEASE);
-        usbMIDI.sendNoteOff(player->trigger1Note, MIDINOTE_VELOCITY, player->midiChannel);
+        setWaveParameters(player->waveLower, params.waveSpeedLower, params.waveDampingLowerRelease);
+        setWaveParameters(player->waveUpper, params.waveSpeedUpper, params.waveDampingUpperRelease);
+        notetracker_noteOff(player->trigger1Note, MIDINOTE_VELOCITY, player->midiChannel);
+        sendTelemetry(TLM_RELEASE, player->playerId, 1, player->trigger1Note);
     }
 
 
     // handle trigger2
 
     trigger2State = digitalRead(player->trigger2Pin);
-    if (now - trigger2FlagsUpdateTime < EXTERNAL_TRIGGER_ACTIVE_PERIOD) 
+    external = sensorinput_linkHealthy(slotBoard[player->playerId * 2 + 1]);
+    if (external) 
         trigger2State= trigger2Flags & (1 << (player->playerId)) ? LOW : HIGH;  // Read trigger2 state from external flags
 
     if ((trigger2State == LOW) && (player->trigger2Active == 0)) {
         lastUserActivity = now;  // Update the last user activity timestamp
-        player->trigger2Timestamp = now;  // remember the timestamp for trigger2
+        player->trigger2Timestamp = external ? sensorOnsetTime[player->playerId * 2 + 1] : now;  // remember the timestamp for trigger2
         player->trigger2Active = 1;
         horizontalPosition = WIDTH/2;
 
@@ -383,9 +443,10 @@ void processPlayers(uint32_t now,PlayerData * player) {
         }
 
         // Set wave parameters for longer wave duration  
-        setWaveParameters(player->waveLower, WAVE_SPEED_LOWER, WAVE_DAMPING_LOWER_TRIGGER);
-        setWaveParameters(player->waveUpper, WAVE_SPEED_UPPER, WAVE_DAMPING_UPPER_TRIGGER);
+        setWaveParameters(player->waveLower, params.waveSpeedLower, params.waveDampingLowerTrigger);
+        setWaveParameters(player->waveUpper, params.waveSpeedUpper, params.waveDampingUpperTrigger);
         triggerWave(horizontalPosition, verticalPosition, player);  // create a wave at the determined position
+        player->trigger2YPos = verticalPosition;
 
         for (int i=0;i<WIDTH;i++) { 
             player->waveLower.setf(xOffset+i, PLAYER_MAX_YPOS+10, 1.0);  // Create ripple in lower layer
@@ -396,15 +457,17 @@ void processPlayers(uint32_t now,PlayerData * player) {
             bigWaveUpper.addf(i*WIDTH+WIDTH/2, HEIGHT-10, 0.05);
         }
             
-        Serial.printf("Player %d trigger2 wave at position %d, mapped to note %d\n", player->playerId, verticalPosition, player->trigger2Note);
-        usbMIDI.sendNoteOn(player->trigger2Note, MIDINOTE_VELOCITY, player->midiChannel);  // MIDI channel = player id + 1
+        int velocity = getNoteVelocity(player->playerId * 2 + 1);
+        sendTelemetry(TLM_TRIGGER, player->playerId, 2, player->trigger2Note, verticalPosition, velocity);
+        notetracker_noteOn(player->trigger2Note, velocity, player->midiChannel);  // MIDI channel = player id + 1
     }
     else if ((trigger2State == HIGH) && (player->trigger2Active == 1)) {
         player->trigger2Active = 0;  // Reset fancy button state
         // Set wave parameters for faster wave decay
-        setWaveParameters(player->waveLower, WAVE_SPEED_LOWER, WAVE_DAMPING_LOWER_RELEASE);
-        setWaveParameters(player->waveUpper, WAVE_SPEED_UPPER, WAVE_DAMPING_UPPER_RELEASE);
-        usbMIDI.sendNoteOff(player->trigger2Note, MIDINOTE_VELOCITY, player->midiChannel);
+        setWaveParameters(player->waveLower, params.waveSpeedLower, params.waveDampingLowerRelease);
+        setWaveParameters(player->waveUpper, params.waveSpeedUpper, params.waveDampingUpperRelease);
+        notetracker_noteOff(player->trigger2Note, MIDINOTE_VELOCITY, player->midiChannel);
+        sendTelemetry(TLM_RELEASE, player->playerId, 2, player->trigger2Note);
     }
 
 }
@@ -428,25 +491,19 @@ void processBigWaves(unsigned long now) {
                 player1->trigger1Timestamp = player2->trigger1Timestamp = player1->trigger2Timestamp = player2->trigger2Timestamp = 0;
 
                 // Trigger the big wave MIDI notes
-                usbMIDI.sendNoteOff(bigwaveNote, MIDINOTE_VELOCITY, BIGWAVE_MIDI_CHANNEL);  // in case note is still on, turn it off
+                notetracker_channelOff(BIGWAVE_MIDI_CHANNEL);  // in case the previous note is still on, turn it off
                 bigwaveNote= player1->tonescale [bigWaveNoteIndex++ % 7];
-                usbMIDI.sendNoteOn(bigwaveNote, MIDINOTE_VELOCITY, BIGWAVE_MIDI_CHANNEL);  // Send MIDI note for big wave effect
-                bigWaveRunTime = now;  // Remember the time when the big wave was triggered
+                notetracker_noteOn(bigwaveNote, MIDINOTE_VELOCITY, BIGWAVE_MIDI_CHANNEL, BIGWAVE_MIDINOTE_DURATION);  // note-off is sent by the note tracker
+                sendTelemetry(TLM_BIGWAVE, i, j, bigwaveNote);
             }
         }
     }
 
     for (int i=0; i < NUMBER_OF_PLAYERS; i++) {
         if (playerArray[i].bigWaveTransition.isActive(now)) {  // Update the big wave transition state
-            Serial.printf("big wave for player %d active!\n", i);
             applyBigWave(now, &playerArray[i]);
         }
     }
-
-    if (bigWaveRunTime > 0 && now - bigWaveRunTime > BIGWAVE_MIDINOTE_DURATION) {
-        bigWaveRunTime = 0;  // Reset the run time
-        usbMIDI.sendNoteOff(bigwaveNote, MIDINOTE_VELOCITY, BIGWAVE_MIDI_CHANNEL);  // Send MIDI note off for big wave effect
-    }
 }
 
 
@@ -471,8 +528,8 @@ void updatePotentiometers(unsigned long now) {
                 int act_volume = map (volumeValue, 0, 1023, 120, 0);  // Read volume from potentiometer
                 if (act_volume != volume) {
                     volume = act_volume;
-                    Serial.printf(" Changing volume to %d\n", act_volume);
-                    usbMIDI.sendControlChange(7, volume, 16);
+                    textOutput.printf(" Changing volume to %d\n", act_volume);
+                    midiqueue_controlChange(7, volume, 16);
                 }
             }
         }
@@ -485,7 +542,8 @@ void updateMode (unsigned long now) {
     if ((digitalRead(MODE_PIN) == LOW) && (now - lastModechangeTimestamp > 2000)) {
         lastModechangeTimestamp=now;
         tonescaleSelection = ( tonescaleSelection + 1 ) % numTonescales;
-        Serial.printf(" Changing tonescale to %s\n", tonescales[tonescaleSelection].name);
+        textOutput.printf(" Changing tonescale to %s\n", tonescales[tonescaleSelection].name);
+        sendTelemetry(TLM_MODE, tonescaleSelection, tonescales[tonescaleSelection].mode);
 
         for (int i = 0; i < NUMBER_OF_PLAYERS; i++) {
             PlayerData * player = &playerArray[i];
@@ -494,7 +552,8 @@ void updateMode (unsigned long now) {
             player->toneProgress = 0;
         }
         teamToneProgress = 0;
-        usbMIDI.sendControlChange(11, tonescaleSelection, 16);
+        notetracker_allNotesOff();  // held notes belong to the old tonescale
+        midiqueue_controlChange(11, tonescaleSelection, 16);
 
         // update big wave mode
         if (tonescales[tonescaleSelection].mode == MODE_RANDOM) {
@@ -511,10 +570,7 @@ void handleIdleAnimation(unsigned long now) {
     if (now - lastUserActivity > USER_ACTIVITY_TIMEOUT) {
         playIdleAnimation();  // Play idle animation if no user activity for a while
     } else {
-        if (idleAnimNote != 0) {  // If idle animation note is set, turn it off!
-            usbMIDI.sendNoteOff(idleAnimNote, MIDINOTE_VELOCITY, 8);  // Stop the MIDI note for idle animation
-            idleAnimNote = 0;  // Reset the idle animation note
-        }
+        notetracker_channelOff(IDLEANIM_MIDI_CHANNEL);  // stop the MIDI note of the idle animation (if any)
     }
     #ifndef USE_RED_GREEN_IDLE_ANIMATION
         Fx::DrawContext ctx(now, leds); // Create a drawing context with the current time and LED array
@@ -531,8 +587,14 @@ void monitorPerformance() {
     if (millis() - frameTime >= 1000) {
         #ifdef CREATE_DEBUG_OUTPUT
             // Every second, print the frame rate
-            Serial.printf("FPS: %d, Free Ram = %d, PixelPin=%d\n", frameCount, freeram(), NEOPIXEL_PIN);
+            textOutput.printf("FPS: %d, Free Ram = %d, PixelPin=%d\n", frameCount, freeram(), NEOPIXEL_PIN);
+            sensorinput_printStats();
+            framestream_printStats();
+            midiqueue_printStats();
+            notetracker_printStats();
         #endif
+        sendTelemetry(TLM_PERFORMANCE, 0, frameCount, freeram() / 1024, telemetry.dropped < 32767 ? telemetry.dropped : 32767,
+                      notetracker_voices(0));
 
         frameCount = 0;  // Reset frame counter
         frameTime = millis();  // Update last frame time
@@ -540,17 +602,154 @@ void monitorPerformance() {
 }
 
 
+// Build the lookup tables for the sensor mapping
+void setupSensorMapping() {
+    memset(sensorSlot, -1, sizeof(sensorSlot));
+    memset(slotBoard, -1, sizeof(slotBoard));
+    for (unsigned int i = 0; i < sizeof(sensorMapping) / sizeof(sensorMapping[0]); i++) {
+        const SensorMapping & m = sensorMapping[i];
+        if (m.board >= SENSORINPUT_NUM_BOARDS || m.channel >= SENSORINPUT_MAX_CHANNELS || m.player >= NUMBER_OF_PLAYERS) continue;
+        int slot = m.player * 2 + (m.trigger == 2 ? 1 : 0);
+        sensorSlot[m.board][m.channel] = slot;
+        slotBoard[slot] = m.board;
+        slotChannel[slot] = m.channel;
+    }
+}
+
+// Apply the events received from the sensor boards
+void processSensorEvents(uint32_t now) {
+    uint32_t nowMicros = micros();
+    SensorEvent ev;
+    while (sensorinput_getEvent(ev)) {
+        if (ev.board >= SENSORINPUT_NUM_BOARDS || ev.channel >= SENSORINPUT_MAX_CHANNELS) continue;
+        int slot = sensorSlot[ev.board][ev.channel];
+        if (slot < 0) continue;
+        uint32_t * flags = (slot & 1) ? &trigger2Flags : &trigger1Flags;
+        switch (ev.type) {
+            case SENSOR_EVENT_STATE:
+                if (ev.value) {
+                    *flags |= (1UL << (slot >> 1));
+                    int32_t age = (int32_t)(nowMicros - ev.sourceTime);
+                    sensorOnsetTime[slot] = now - (age > 0 ? age / 1000 : 0);  // onset time in the millis() domain
+                }
+                else          *flags &= ~(1UL << (slot >> 1));
+                break;
+            case SENSOR_EVENT_HIT:
+                sensorVelocity[slot] = ev.value;
+                break;
+            case SENSOR_EVENT_FEATURES: {
+                const SensorHitFeatures * hit = sensorinput_getHitFeatures(ev.board, ev.channel);
+                sendTelemetry(TLM_HIT_FEATURES, slot >> 1, (slot & 1) + 1, hit->peak < 32767 ? hit->peak : 32767,
+                              hit->riseTime < 32767 ? hit->riseTime : 32767, hit->energy < 32767 ? hit->energy : 32767);
+                break;
+            }
+        }
+    }
+}
+
+// Use the sensor envelopes of active triggers for the wave amplitude and MIDI aftertouch
+void processEnvelopes(uint32_t now) {
+    static uint8_t lastPressure[NUMBER_OF_PLAYERS * 2] = {0};
+    static uint32_t aftertouchTime = 0;
+    bool sendAftertouch = (now - aftertouchTime >= ENVELOPE_AFTERTOUCH_PERIOD);
+    if (sendAftertouch) aftertouchTime = now;
+
+    for (int slot = 0; slot < NUMBER_OF_PLAYERS * 2; slot++) {
+        PlayerData * player = &playerArray[slot >> 1];
+        bool active = (slot & 1) ? player->trigger2Active : player->trigger1Active;
+        if (!active || !sensorinput_linkHealthy(slotBoard[slot])) continue;
+
+        uint8_t level = sensorEnvelopeLatest(sensorinput_getEnvelope(slotBoard[slot], slotChannel[slot]), now, ENVELOPE_MAX_AGE);
+        int yPos = (slot & 1) ? player->trigger2YPos : player->trigger1YPos;
+        if (level) {   // keep feeding the wave while the pad is pressed
+            player->waveLower.addf(player->playerId * WIDTH + WIDTH / 2, yPos, level * ENVELOPE_WAVE_GAIN);
+            player->waveUpper.addf(player->playerId * WIDTH + WIDTH / 2, yPos, level * ENVELOPE_WAVE_GAIN);
+        }
+
+        uint8_t pressure = level >> 1;   // 0-127
+        int note = (slot & 1) ? player->trigger2Note : player->trigger1Note;
+        if (sendAftertouch && pressure != lastPressure[slot] && notetracker_isActive(note, player->midiChannel)) {
+            midiqueue_afterTouchPoly(note, pressure, player->midiChannel);
+            lastPressure[slot] = pressure;
+        }
+    }
+}
+
+// Copy every n-th frame into a rectangular image (optionally downscaled by 2) and pass it to the frame stream
+void streamFrame() {
+    static int frameCounter = 0;
+    if (!params.frameStream || ++frameCounter < params.frameStream) return;
+    frameCounter = 0;
+
+    int scale = params.frameScale == 2 ? 2 : 1;
+    int width = WIDTH * NUMBER_OF_PLAYERS / scale, height = HEIGHT / scale;
+    uint8_t * out = streamImage;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < scale; dy++) {
+                for (int dx = 0; dx < scale; dx++) {
+                    const CRGB & c = leds[xyMap.mapToIndex(x * scale + dx, y * scale + dy)];
+                    r += c.r; g += c.g; b += c.b;
+                }
+            }
+            *out++ = r / (scale * scale);
+            *out++ = g / (scale * scale);
+            *out++ = b / (scale * scale);
+        }
+    }
+    framestream_submit(streamImage, width, height);   // dropped if the host did not read the previous frame yet
+}
+
+// Apply runtime parameters modified by the serial command shell (called between two frames)
+void applyParams(uint8_t changes) {
+    Blend2dParams lower_params = { .blur_amount = (uint8_t)params.blurAmountLower, .blur_passes = (uint8_t)params.blurPassesLower };
+    Blend2dParams upper_params = { .blur_amount = (uint8_t)params.blurAmountUpper, .blur_passes = (uint8_t)params.blurPassesUpper };
+
+    for (int i = 0; i < NUMBER_OF_PLAYERS; i++) {
+        PlayerData & p = playerArray[i];
+        if (changes & PARAMS_APPLY_WAVE) {
+            bool active = p.trigger1Active || p.trigger2Active;
+            setWaveParameters(p.waveLower, params.waveSpeedLower, active ? params.waveDampingLowerTrigger : params.waveDampingLowerRelease);
+            setWaveParameters(p.waveUpper, params.waveSpeedUpper, active ? params.waveDampingUpperTrigger : params.waveDampingUpperRelease);
+        }
+        if (changes & PARAMS_APPLY_BLUR) {
+            fxBlend.setParams(p.waveLower, lower_params);
+            fxBlend.setParams(p.waveUpper, upper_params);
+        }
+        if (changes & PARAMS_APPLY_SUPERSAMPLE) {
+            p.waveLower.setSuperSample((SuperSample)params.superSample);
+            p.waveUpper.setSuperSample((SuperSample)params.superSample);
+        }
+    }
+    if (changes & PARAMS_APPLY_BLUR) {
+        fxBlend.setParams(bigWaveLower, lower_params);
+        fxBlend.setParams(bigWaveUpper, upper_params);
+    }
+    if (changes & PARAMS_APPLY_SUPERSAMPLE) {
+        bigWaveLower.setSuperSample((SuperSample)params.superSample);
+        bigWaveUpper.setSuperSample((SuperSample)params.superSample);
+        textOutput.printf("Free Ram = %d\n", freeram());   // super sampling needs a lot of RAM
+    }
+    if (changes & PARAMS_APPLY_BRIGHTNESS) FastLED.setBrightness(params.brightness);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
 // Setup function to initialize the wave effects and LED strip
 void wavefx_setup() {
 
     Serial.print("Initial Free Ram = "); Serial.println(freeram());
+    tlm_init(&telemetry);
     pinMode (POTI_GND_PIN, OUTPUT);
     digitalWrite(POTI_GND_PIN, LOW);  // Set the ground pin for the potentiometer
     pinMode (MODE_PIN, INPUT_PULLUP);
     pinMode (MODE_GND_PIN, OUTPUT);
     digitalWrite(MODE_GND_PIN, LOW);  // Set the ground pin for the mode button
+    delayMicroseconds(100);           // let the pull-up settle, params_setup() reads the mode button
+    params_setup();
+    sensorinput_setup();
+    setupSensorMapping();
 
 
     // Initialize the LED strip (setScreenMap connects our 2D coordinate system to the 1D LED array)
@@ -577,13 +776,13 @@ void wavefx_setup() {
 
     // Create parameter structures for each wave layer's blur settings
     Blend2dParams lower_params = {
-        .blur_amount = BLUR_AMOUNT_LOWER,            // Blur amount for lower layer
-        .blur_passes = BLUR_PASSES_LOWER,            // Blur passes for lower layer
+        .blur_amount = (uint8_t)params.blurAmountLower,   // Blur amount for lower layer
+        .blur_passes = (uint8_t)params.blurPassesLower,   // Blur passes for lower layer
     };
 
     Blend2dParams upper_params = {
-        .blur_amount = BLUR_AMOUNT_UPPER,           // Blur amount for upper layer
-        .blur_passes = BLUR_PASSES_UPPER,            // Blur passes for upper layer
+        .blur_amount = (uint8_t)params.blurAmountUpper,   // Blur amount for upper layer
+        .blur_passes = (uint8_t)params.blurPassesUpper,   // Blur passes for upper layer
     };
 
     for (int i = 0; i < NUMBER_OF_PLAYERS; i++) {
@@ -600,8 +799,8 @@ void wavefx_setup() {
         p.waveLower.setEasingMode(U8EasingFunction::WAVE_U8_MODE_LINEAR);
         p.waveUpper.setCrgbMap(palPurpleWhite);
         p.waveUpper.setEasingMode(U8EasingFunction::WAVE_U8_MODE_LINEAR);
-        setWaveParameters(p.waveLower, WAVE_SPEED_LOWER, WAVE_DAMPING_LOWER_RELEASE);  // default wave parameters for lower layer
-        setWaveParameters(p.waveUpper, WAVE_SPEED_UPPER, WAVE_DAMPING_UPPER_RELEASE);  // Set wave parameters for upper layer
+        setWaveParameters(p.waveLower, params.waveSpeedLower, params.waveDampingLowerRelease);  // default wave parameters for lower layer
+        setWaveParameters(p.waveUpper, params.waveSpeedUpper, params.waveDampingUpperRelease);  // Set wave parameters for upper layer
 
         // Add wave layers to the blender (order matters - lower layer is added first (background))
         fxBlend.add(p.waveLower);
@@ -639,29 +838,30 @@ void wavefx_setup() {
     fxBlend.setGlobalBlurAmount(0);       // Overall blur strength
     fxBlend.setGlobalBlurPasses(1);       // Number of blur passes
 
-    FastLED.setBrightness(MAXIMUM_BRIGHTNESS);  // Default brightness for the LED strip
+    FastLED.setBrightness(params.brightness);  // Default brightness for the LED strip
 }
 
 
 void wavefx_loop() {
-    uint32_t now = millis();
-    while (Serial1.available()) {
-        int flags = Serial1.read();  // Read incoming bytes from Serial1
-        if (flags & 0x80) { 
-            trigger2Flags = flags;  // If the high bit is set, it's for trigger2
-            trigger2FlagsUpdateTime = now;  // Update the timestamp for trigger2 flags
-            Serial.printf("Received trigger2 flags: %02X\n", trigger2Flags);
-        }
-        else {
-            trigger1Flags = flags;  // Otherwise, it's for trigger1
-            trigger1FlagsUpdateTime = now;  // Update the timestamp for trigger1 flags
-            Serial.printf("Received trigger1 flags: %02X\n", trigger1Flags);
-        }
+    static uint32_t lastRenderTime = 0;  // micros() of the last rendered frame
+    uint8_t changes = params_poll();   // serial command shell, changes are applied before the next frame
+    if (changes) applyParams(changes);
+
+    if (params.targetFps && micros() - lastRenderTime < 1000000UL / params.targetFps) {
+        sensorinput_poll();      // keep the sensor links serviced while waiting for the next frame
+        if (!framestream_flush()) flushTelemetry();
+        return;
     }
+    lastRenderTime = micros();
+
+    uint32_t now = millis();
+    sensorinput_poll();          // parse bytes received from the sensor boards (non-blocking)
+    processSensorEvents(now);
 
     // Apply current settings and get button states for all players
     for (int i = 0; i < NUMBER_OF_PLAYERS; i++)   
         processPlayers(now, &playerArray[i]);   
+    processEnvelopes(now);       // expressive control from the sensor envelopes
     
     updatePotentiometers(now);   // update potentiometers for user settings
     updateMode(now);
@@ -675,8 +875,13 @@ void wavefx_loop() {
         }
     }
 
+    notetracker_update(now);     // scheduled note-offs
+    midiqueue_flush();           // send the MIDI messages of this frame as one batch, before the LED output
     FastLED.show();              // send the color data to the actual LEDs
+    streamFrame();               // frame stream for preview/capture (if enabled)
     monitorPerformance();
+    if (!framestream_flush())    // frame packets and telemetry records share USB Serial, never interleave them
+        flushTelemetry();        // write pending telemetry records (non-blocking)
 }
 
 
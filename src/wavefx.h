@@ -3,6 +3,7 @@
 #include <FastLED.h>      // Main FastLED library for controlling LEDs
 
 #define CREATE_DEBUG_OUTPUT     // define to create FPS and free RAM debug output in the serial console
+#define CREATE_TELEMETRY_OUTPUT // define to send binary telemetry records (triggers, big waves, FPS), see tools/telemetry_decode.py
 //#define USE_RED_GREEN_IDLE_ANIMATION   // define to use the red-green idle animation 
 #define PLAY_IDLE_ANIM_NOTES // define to play MIDI notes during idle animation
 
@@ -41,6 +42,7 @@
 #define BIGWAVE_DAMPING_LOWER 10.0f
 #define BIGWAVE_DAMPING_UPPER 10.5f
 #define BIGWAVE_MIDI_CHANNEL 7  
+#define IDLEANIM_MIDI_CHANNEL 8
 
 #define NUM_LEDS (WIDTH * HEIGHT * NUMBER_OF_PLAYERS)   // Total number of LEDs
 #define NUM_LEDS_PER_PLANE (WIDTH * HEIGHT)   // Total number of LEDs per stripe (multi strip setup)
@@ -61,15 +63,22 @@
 #define MIDINOTE_VELOCITY 120   // MIDI note velocity for sending notes
 
 #define BIGWAVE_TIME_THRESHOLD 20  // Time in milliseconds to consider two wave triggers as "close enough" for big waves
-#define EXTERNAL_TRIGGER_ACTIVE_PERIOD 2000 // Time in milliseconds to override buttons with external triggers (from Serial1)
+
+#define ENVELOPE_WAVE_GAIN 0.0004f      // wave energy added per frame and envelope unit while a pad is pressed
+#define ENVELOPE_AFTERTOUCH_PERIOD 20    // Time in milliseconds between MIDI aftertouch updates
+#define ENVELOPE_MAX_AGE 50              // Envelope samples older than this (in milliseconds) are ignored
 
 #define BIGWAVE_MIDINOTE_DURATION 5000 // Duration in milliseconds for big wave effect (fixed duration)
 #define USER_ACTIVITY_TIMEOUT 10000 // Time in milliseconds to consider user inactive
 #define CANON_INACTIVITY_TIMEOUT 2000 // Time in milliseconds for canon reset
 
 // Important: super sampling consumes more RAM and CPU! (2X or 4X result in out-of-memory crashes if full 40x50 matrix is used!!
-#define SUPER_SAMPLE_MODE SuperSample::SUPER_SAMPLE_NONE;  // SUPER_SAMPLE_2X or SUPER_SAMPLE_4X to create smoother waves
-//#define SUPER_SAMPLE_MODE SuperSample::SUPER_SAMPLE_2X; 
+#define SUPER_SAMPLE_FACTOR 1   // 1 (none), 2 or 4 to create smoother waves
+#define SUPER_SAMPLE_MODE ((SuperSample)SUPER_SAMPLE_FACTOR)
+
+#define TARGET_FPS 0            // limit the frame rate (0 = unlimited), can be changed with the serial command shell (see params.h)
+#define FRAME_STREAM_DIVIDER 0  // stream every n-th frame via USB Serial for preview/capture (0 = off), see framestream.cpp
+#define FRAME_STREAM_SCALE 1    // 2: stream the frames downscaled to half width and height
 
 void wavefx_setup();
 void wavefx_loop();
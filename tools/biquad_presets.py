@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+Neopixel Kalimba, for Zoom Museum Vienna, 2025
+(c) Michael Strohmann and Chris Veigl
+
+Generates src/FloorSensorReader/biquadpresets.h: Q30 lowpass coefficients (RBJ cookbook,
+Q = 0.707) of the FloorSensorReader filters for preset cutoff frequencies and sample rates,
+so the sketch needs no sinf/cosf at startup or when the filters are retuned at runtime.
+
+usage: python3 tools/biquad_presets.py > src/FloorSensorReader/biquadpresets.h
+"""
+
+import math
+
+SAMPLE_RATES = [1000, 2000, 4000]
+SIGNAL_CUTOFFS = [10, 15, 20, 25, 35, 50, 70, 100]     # trigger signal lowpass (Hz)
+BASELINE_CUTOFFS = [0.3, 0.5, 0.8, 1.2, 2.0]           # baseline lowpass (Hz)
+Q = 0.707
+
+
+def q30(c):
+    return max(-2**31, min(2**31 - 1, round(c * 2**30)))
+
+
+def lowpass(f, fs):
+    w0 = 2 * math.pi * f / fs
+    alpha = math.sin(w0) / (2 * Q)
+    a0 = 1 + alpha
+    b0 = (1 - math.cos(w0)) / 2 / a0
+    return [q30(b0), q30((1 - math.cos(w0)) / a0), q30(b0),
+            q30(-2 * math.cos(w0) / a0), q30((1 - alpha) / a0)]
+
+
+def cutoffs(values):
+    return ", ".join("%.1ff" % f for f in values)
+
+
+print("""/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   by Michael Strohmann and Chris Veigl
+
+    Precomputed lowpass coefficients (Q30, Q = 0.707) for the preset cutoff frequencies and
+    sample rates, generated by tools/biquad_presets.py - do not edit, run the script instead.
+    Other combinations are computed at runtime (see biquad_preset_lowpass()).
+*/
+
+#ifndef BIQUADPRESETS_H
+#define BIQUADPRESETS_H
+
+#include "biquadbank.h"
+
+typedef struct {
+    uint16_t sampleRate;                     // Hz
+    uint16_t cutoff;                         // Hz * 100
+    BiquadCoefs coefs;
+} BiquadPreset;
+""")
+print("#define BIQUAD_SIGNAL_PRESETS %d" % len(SIGNAL_CUTOFFS))
+print("#define BIQUAD_BASELINE_PRESETS %d" % len(BASELINE_CUTOFFS))
+print("static const float biquadSignalCutoffs[BIQUAD_SIGNAL_PRESETS] = { %s };" % cutoffs(SIGNAL_CUTOFFS))
+print("static const float biquadBaselineCutoffs[BIQUAD_BASELINE_PRESETS] = { %s };" % cutoffs(BASELINE_CUTOFFS))
+print()
+print("static const BiquadPreset biquadPresets[] = {")
+for fs in SAMPLE_RATES:
+    for f in SIGNAL_CUTOFFS + BASELINE_CUTOFFS:
+        print("    { %4d, %5d, { %s } }," % (fs, round(f * 100), ", ".join("%11d" % c for c in lowpass(f, fs))))
+print("};")
+print("""
+// Lowpass coefficients for cutoff f at sampling rate fs: from the table if it is a preset, computed otherwise
+static inline void biquad_preset_lowpass(BiquadCoefs *coefs, float f, float fs) {
+    long cutoff = lroundf(f * 100.0f), rate = lroundf(fs);
+    for (unsigned int i = 0; i < sizeof(biquadPresets) / sizeof(biquadPresets[0]); i++) {
+        if (biquadPresets[i].sampleRate == rate && biquadPresets[i].cutoff == cutoff) {
+            *coefs = biquadPresets[i].coefs;
+            return;
+        }
+    }
+    biquad_lowpass_coefs(coefs, f, 0.707f, fs);
+}
+
+#endif""")
@@ -0,0 +1,190 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Equivalence test and benchmark of the fixed-point biquad bank
+    (src/FloorSensorReader/biquadbank.h) against the float biquad it replaced
+    (iir_lowpass2_init() / iir_lowpass2_process(), one filter struct per channel), and against
+    the same biquad in double precision.
+
+    Synthetic ADC traces (slow baseline drift, noise, impacts of different strength,
+    full scale steps, clipping at 0 and 1023) are filtered by both implementations with the
+    signal (35 Hz) and baseline (0.8 Hz) lowpass of the sensor reader, and the band-pass of
+    the footstep classifier. The bank may differ by at most MAX_DIFFERENCE ADC units from the
+    double biquad. The difference to the float biquad is reported, it also contains the error
+    of the float biquad itself: for the 0.8 Hz lowpass its coefficients lack precision (a1 is
+    about -2, the DC gain is off by some 0.1% at 1 kHz and by several % at 4 kHz).
+    Then both implementations are timed for 10 and 64 channels.
+
+    Build and run:
+      g++ -O2 -o biquadtest tools/biquadtest/biquadtest.cpp
+      g++ -O1 -g -fsanitize=address,undefined -o biquadtest tools/biquadtest/biquadtest.cpp   (checks for overflows)
+      ./biquadtest [seconds of signal (60)] [sample rate (1000)]
+
+    The exit code is 1 if the bank differs from the double biquad by more than MAX_DIFFERENCE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include "../../src/FloorSensorReader/biquadpresets.h"
+
+#define MAX_DIFFERENCE 1         // ADC units
+#define CHANNELS 10
+#define BENCH_CHANNELS 64
+
+// the biquad of the original FloorSensorReader (T = float), coefficients computed like iir_lowpass2_init()
+// T = double is the exact reference
+template <typename T> struct Reference {
+    T b0, b1, b2;
+    T a1, a2;
+    T xv1, xv2;
+    T yv1, yv2;
+
+    void init(bool bandpass, T f, T Q, T fs) {
+        T w0    = (T)2 * (T)M_PI * f / fs;
+        T alpha = sin(w0) / ((T)2 * Q);
+        T a0    = (T)1 + alpha;
+        if (bandpass) {
+            b0 = alpha / a0;
+            b1 = 0;
+            b2 = -alpha / a0;
+        } else {
+            b0 = ((T)1 - cos(w0)) / (T)2 / a0;
+            b1 = ((T)1 - cos(w0)) / a0;
+            b2 = b0;
+        }
+        a1 = (T)-2 * cos(w0) / a0;
+        a2 = ((T)1 - alpha) / a0;
+        xv1 = xv2 = yv1 = yv2 = 0;
+    }
+
+    int process(int x) {
+        T xn = (T)x;
+        T yn = b0 * xn + b1 * xv1 + b2 * xv2 - a1 * yv1 - a2 * yv2;
+        xv2 = xv1;
+        xv1 = xn;
+        yv2 = yv1;
+        yv1 = yn;
+        return (int)floor(yn);   // rounded down like the bank (the original truncated towards zero)
+    }
+};
+
+// synthetic ADC trace of one channel
+static std::vector<int> makeTrace(int channel, int scans, int sampleRate) {
+    std::vector<int> trace(scans);
+    double impact = 0;
+    for (int s = 0; s < scans; s++) {
+        double t = (double)s / sampleRate;
+        double v = 400 + 60 * sin(2 * M_PI * 0.05 * t + channel) + (rand() % 7 - 3);   // drift and noise
+        if (rand() % (sampleRate * 2) == 0) impact = 50 + rand() % 700;                  // hit: fast rise, slow decay
+        v += impact;
+        impact *= 0.97;
+        if ((s / (sampleRate * 5)) % 4 == 3 && channel == 0) v = (s / (sampleRate / 2)) % 2 ? 1023 : 0;   // full scale steps
+        if (v < 0) v = 0;
+        if (v > 1023) v = 1023;
+        trace[s] = (int)v;
+    }
+    return trace;
+}
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// filters the traces with the bank (lowpass coefficients like sensordsp_init(): preset or computed), the
+// float and the double biquad, returns the largest difference to double in ADC units
+static int compare(const char *name, bool bandpass, float f, float fs, const std::vector<std::vector<int>> &traces) {
+    static BiquadBank bank;
+    Reference<float> single[CHANNELS];
+    Reference<double> exact[CHANNELS];
+    if (bandpass) biquad_bank_bandpass(&bank, f, 0.707f, fs);
+    else {
+        BiquadCoefs coefs;
+        biquad_preset_lowpass(&coefs, f, fs);
+        biquad_bank_set_coefs(&bank, &coefs);
+    }
+    biquad_bank_init(&bank, CHANNELS);
+    for (int i = 0; i < CHANNELS; i++) {
+        single[i].init(bandpass, f, 0.707f, fs);
+        exact[i].init(bandpass, f, 0.707f, fs);
+    }
+
+    int in[CHANNELS], out[CHANNELS], maxFloat = 0, maxDouble = 0, floatError = 0;
+    long differing = 0;
+    size_t scans = traces[0].size();
+    for (size_t s = 0; s < scans; s++) {
+        for (int i = 0; i < CHANNELS; i++) in[i] = traces[i][s];
+        biquad_bank_process(&bank, in, out);
+        for (int i = 0; i < CHANNELS; i++) {
+            int y = single[i].process(in[i]), yExact = exact[i].process(in[i]);
+            if (out[i] != y) differing++;
+            if (abs(out[i] - y) > maxFloat) maxFloat = abs(out[i] - y);
+            if (abs(out[i] - yExact) > maxDouble) maxDouble = abs(out[i] - yExact);
+            if (abs(y - yExact) > floatError) floatError = abs(y - yExact);
+        }
+    }
+    printf("%-24s bank - float %d, bank - double %d, float - double %d ADC units (%.3f%% of the samples differ from float)%s\n",
+           name, maxFloat, maxDouble, floatError, differing * 100.0 / (scans * CHANNELS), maxDouble > MAX_DIFFERENCE ? "  FAILED" : "");
+    return maxDouble;
+}
+
+static void benchmark(int channels, int sampleRate) {
+    static BiquadBank bank;
+    static Reference<float> reference[BENCH_CHANNELS];
+    biquad_bank_lowpass(&bank, 35.0f, 0.707f, (float)sampleRate);
+    biquad_bank_init(&bank, channels);
+    for (int i = 0; i < channels; i++) reference[i].init(false, 35.0f, 0.707f, (float)sampleRate);
+
+    const int scans = 200000;
+    int in[BENCH_CHANNELS], out[BENCH_CHANNELS];
+    volatile int sink = 0;
+    for (int i = 0; i < channels; i++) in[i] = 300 + i;
+
+    double start = seconds();
+    for (int s = 0; s < scans; s++) {
+        in[s % channels] ^= 0x40;
+        biquad_bank_process(&bank, in, out);
+        sink += out[0];
+    }
+    double fixedTime = seconds() - start;
+    start = seconds();
+    for (int s = 0; s < scans; s++) {
+        in[s % channels] ^= 0x40;
+        for (int i = 0; i < channels; i++) out[i] = reference[i].process(in[i]);
+        sink += out[0];
+    }
+    double floatTime = seconds() - start;
+    printf("%2d channels: bank %.1f ns, float %.1f ns per sample (host, the Teensy3.2 has no FPU)\n", channels,
+           fixedTime * 1e9 / scans / channels, floatTime * 1e9 / scans / channels);
+}
+
+int main(int argc, char **argv) {
+    int duration = argc > 1 ? atoi(argv[1]) : 60;
+    int sampleRate = argc > 2 ? atoi(argv[2]) : 1000;
+    if (duration < 1 || sampleRate < 100) {
+        fprintf(stderr, "usage: %s [seconds of signal (60)] [sample rate (1000)]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    std::vector<std::vector<int>> traces;
+    for (int i = 0; i < CHANNELS; i++) traces.push_back(makeTrace(i, duration * sampleRate, sampleRate));
+
+    int maxDiff = 0, diff;
+    diff = compare("signal lowpass 35 Hz", false, 35.0f, (float)sampleRate, traces);
+    if (diff > maxDiff) maxDiff = diff;
+    diff = compare("baseline lowpass 0.8 Hz", false, 0.8f, (float)sampleRate, traces);
+    if (diff > maxDiff) maxDiff = diff;
+    diff = compare("band-pass 15 Hz", true, 15.0f, (float)sampleRate, traces);
+    if (diff > maxDiff) maxDiff = diff;
+
+    benchmark(CHANNELS, sampleRate);
+    benchmark(BENCH_CHANNELS, sampleRate);
+    return maxDiff > MAX_DIFFERENCE ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Neopixel Kalimba, for Zoom Museum Vienna, 2025
+(c) Michael Strohmann and Chris Veigl
+
+Reassembles the frame stream of the Teensy4.1 firmware (see src/framestream.cpp)
+into images. Enable the stream on the device with the serial command
+"set frame_stream <n>" (every n-th frame), optionally "set frame_scale 2".
+
+Reads from a serial port (needs pyserial) or from a capture file and writes one
+image per frame into the output directory: PNG if Pillow is installed, else PPM.
+Delta frames received after a corrupted or missing packet are skipped until the
+next keyframe.
+
+Examples:
+  python3 tools/framestream_decode.py /dev/ttyACM0 frames/
+  python3 tools/framestream_decode.py capture.bin frames/ --zoom 8
+"""
+
+import argparse
+import os
+import sys
+
+SYNC1, SYNC2 = 0xA9, 0x46
+HEADER_SIZE = 9
+FLAG_KEYFRAME = 0x01
+
+try:
+    from PIL import Image
+except ImportError:
+    Image = None
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def decode_rle(data, size):
+    out = bytearray()
+    i = 0
+    while i < len(data) and len(out) < size:
+        c = data[i]
+        if c < 128:
+            out += data[i + 1:i + 2 + c]
+            i += c + 2
+        else:
+            out += bytes([data[i + 1]]) * (c - 126)
+            i += 2
+    return out if len(out) == size else None
+
+
+def packets(stream):
+    """Yield (seq, width, height, flags, payload) of all packets with a valid CRC."""
+    buf = bytearray()
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            break
+        buf += chunk
+        while True:
+            start = buf.find(bytes([SYNC1, SYNC2]))
+            if start < 0:
+                del buf[:-1]
+                break
+            del buf[:start]
+            if len(buf) < HEADER_SIZE:
+                break
+            length = buf[7] | buf[8] << 8
+            if len(buf) < HEADER_SIZE + length + 1:
+                break
+            if crc8(buf[2:HEADER_SIZE + length]) != buf[HEADER_SIZE + length]:
+                del buf[:1]   # not a valid packet, search the next sync
+                continue
+            yield buf[2] | buf[3] << 8, buf[4], buf[5], buf[6], bytes(buf[HEADER_SIZE:HEADER_SIZE + length])
+            del buf[:HEADER_SIZE + length + 1]
+
+
+def save_image(path, width, height, rgb, zoom):
+    if Image:
+        img = Image.frombytes("RGB", (width, height), bytes(rgb))
+        if zoom > 1:
+            img = img.resize((width * zoom, height * zoom), Image.NEAREST)
+        img.save(path + ".png")
+    else:
+        with open(path + ".ppm", "wb") as f:
+            f.write(b"P6 %d %d 255\n" % (width, height))
+            f.write(rgb)
+
+
+def open_input(name):
+    try:
+        return open(name, "rb")
+    except OSError:
+        import serial  # pyserial, only needed for live capture
+        return serial.Serial(name, 115200, timeout=0.1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port or capture file")
+    parser.add_argument("outdir", help="directory for the images")
+    parser.add_argument("--zoom", type=int, default=4, help="enlarge images (PNG only)")
+    args = parser.parse_args()
+    os.makedirs(args.outdir, exist_ok=True)
+
+    image = None
+    last_seq = None
+    saved = skipped = 0
+    try:
+        for seq, width, height, flags, payload in packets(open_input(args.input)):
+            if last_seq is not None and seq != (last_seq + 1) & 0xFFFF:
+                image = None   # packets were lost, wait for the next keyframe
+            last_seq = seq
+            data = decode_rle(payload, width * height * 3)
+            if data is None:
+                image = None
+                skipped += 1
+                continue
+            if flags & FLAG_KEYFRAME:
+                image = data
+            elif image is not None and len(image) == len(data):
+                image = bytearray(a ^ b for a, b in zip(image, data))
+            else:
+                skipped += 1
+                continue
+            save_image(os.path.join(args.outdir, "frame%05d" % saved), width, height, image, args.zoom)
+            saved += 1
+    except KeyboardInterrupt:
+        pass
+    print("%d frames saved, %d skipped" % (saved, skipped), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
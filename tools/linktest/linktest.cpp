@@ -0,0 +1,235 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Host tests for the sensor link protocol (src/FloorSensorReader/sensorlink.h, the same code
+    as on the Teensy3.2 and the Teensy4.1): encode/decode round trips of all frame types and
+    payload helpers, CRC and resync cases, and a fuzz feeder which runs random bytes and
+    mutated frames through the parser and the payload helpers.
+
+    Build and run (the sanitizers catch out-of-bounds reads in the payload helpers):
+      g++ -O1 -g -fsanitize=address,undefined -o linktest tools/linktest/linktest.cpp
+      ./linktest [fuzz bytes (10000000)] [seed (1)]
+
+    Prints the failed checks and a summary, the exit code is 1 if a check failed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/FloorSensorReader/sensorlink.h"
+
+static int checks = 0, failures = 0;
+
+#define CHECK(cond) do { checks++; if (!(cond)) { failures++; printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+// Feeds n bytes into the parser, returns the number of valid frames (the last one stays in the parser)
+static int feed(SlinkParser *p, const uint8_t *data, int n) {
+    int frames = 0;
+    for (int i = 0; i < n; i++) frames += slink_parser_feed(p, data[i]);
+    return frames;
+}
+
+// Encodes a frame and decodes it again, checks header and payload
+static void roundTrip(SlinkParser *p, uint8_t seq, uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[SLINK_MAX_FRAME];
+    int n = slink_encode(frame, seq, type, payload, len);
+    CHECK(n == SLINK_HEADER_SIZE + len + 1);
+    CHECK(feed(p, frame, n) == 1);
+    CHECK(p->type == type && p->seq == seq && p->len == len);
+    CHECK(memcmp(p->payload, payload, len) == 0);
+}
+
+static void testCrc() {
+    const uint8_t check[] = "123456789";
+    CHECK(slink_crc8(check, 9) == 0xF4);   // CRC-8/SMBUS check value
+    CHECK(slink_crc8(check, 0) == 0);
+}
+
+static void testRoundTrips() {
+    SlinkParser p;
+    slink_parser_init(&p);
+    uint8_t payload[SLINK_MAX_PAYLOAD] = { 0 };
+
+    // empty and maximum payloads, every type and sequence number wraps around
+    roundTrip(&p, 0, SLINK_TYPE_HEARTBEAT, payload, 0);
+    for (int i = 0; i < SLINK_MAX_PAYLOAD; i++) payload[i] = (uint8_t)(i * 37 + 5);
+    payload[3] = SLINK_SYNC;   // sync bytes inside the payload must not disturb the parser
+    roundTrip(&p, 1, 0xFF, payload, SLINK_MAX_PAYLOAD);
+    for (int seq = 2; seq < 300; seq++) roundTrip(&p, (uint8_t)seq, (uint8_t)seq, payload, seq % (SLINK_MAX_PAYLOAD + 1));
+    CHECK(p.lostFrames == 0 && p.crcErrors == 0 && p.syncErrors == 0);
+    CHECK(slink_encode(payload, 0, 0, payload, SLINK_MAX_PAYLOAD + 1) == 0);
+
+    // integers
+    int len = slink_put_u16(payload, 0, 0xBEEF);
+    len = slink_put_u32(payload, len, 0x12345678);
+    CHECK(len == 6 && slink_get_u16(payload) == 0xBEEF && slink_get_u32(payload + 2) == 0x12345678);
+
+    // STATES with age and timestamp, built bytewise and wordwise
+    uint8_t bits[8] = { 0x81, 0x00, 0xFF, 0x12, 0x34, 0x56, 0x78, 0x9A };
+    for (int channels = 1; channels <= SLINK_MAX_CHANNELS; channels++) {
+        len = slink_build_states(payload, bits, channels);
+        uint8_t words[SLINK_MAX_PAYLOAD];
+        int wordLen = slink_init_states(words, channels);
+        for (int w = 0; w < (channels + 31) / 32; w++)
+            slink_states_put_word(words, w, bits[w * 4] | bits[w * 4 + 1] << 8 | bits[w * 4 + 2] << 16 | (uint32_t)bits[w * 4 + 3] << 24);
+        CHECK(wordLen == len && memcmp(words, payload, len) == 0);
+        len = slink_put_u16(payload, len, 1234);
+        len = slink_put_u32(payload, len, 0xCAFEF00D);
+        roundTrip(&p, (uint8_t)channels, SLINK_TYPE_STATES, payload, len);
+        CHECK(slink_states_channels(&p) == channels);
+        CHECK(slink_states_age(&p) == 1234);
+        uint32_t timestamp = 0;
+        CHECK(slink_states_timestamp(&p, &timestamp) && timestamp == 0xCAFEF00D);
+        for (int ch = 0; ch < channels; ch++) CHECK(slink_states_bit(&p, ch) == ((bits[ch >> 3] >> (ch & 7)) & 1));
+    }
+    len = slink_build_states(payload, bits, 10);   // without age and timestamp
+    roundTrip(&p, 0, SLINK_TYPE_KEYFRAME, payload, len);
+    uint32_t timestamp;
+    CHECK(slink_states_age(&p) == SLINK_AGE_UNKNOWN && !slink_states_timestamp(&p, &timestamp));
+
+    // HITS and FEATURES until the payload is full
+    len = 0;
+    for (int i = 0; i < 30; i++) len = slink_add_hit(payload, len, i, 100 + i, i * 8);
+    CHECK(len == SLINK_MAX_PAYLOAD / SLINK_HIT_SIZE * SLINK_HIT_SIZE);
+    roundTrip(&p, 0, SLINK_TYPE_HITS, payload, len);
+    CHECK(slink_hits_count(&p) == SLINK_MAX_PAYLOAD / SLINK_HIT_SIZE);
+    CHECK(p.payload[5 * SLINK_HIT_SIZE + 1] == 105 && p.payload[5 * SLINK_HIT_SIZE + 2] == 40);
+    len = 0;
+    for (int i = 0; i < 20; i++) len = slink_add_features(payload, len, i, 1000 + i, 2000 + i, 65535);
+    roundTrip(&p, 0, SLINK_TYPE_FEATURES, payload, len);
+    CHECK(slink_features_count(&p) == SLINK_MAX_PAYLOAD / SLINK_FEATURES_SIZE);
+    CHECK(slink_get_u16(&p.payload[3 * SLINK_FEATURES_SIZE + 1]) == 1003 && slink_get_u16(&p.payload[3 * SLINK_FEATURES_SIZE + 3]) == 2003);
+
+    // ENVELOPE: small deltas are exact, large jumps saturate and catch up without accumulating errors
+    const int n = 4;
+    uint8_t samples[3][n] = { { 10, 20, 15, 15 }, { 0, 255, 255, 0 }, { 200, 100, 0, 1 } };
+    payload[0] = n;
+    len = 1;
+    for (int ch = 0; ch < 3; ch++) len = slink_add_envelope(payload, len, ch * 2, samples[ch], n);
+    roundTrip(&p, 0, SLINK_TYPE_ENVELOPE, payload, len);
+    CHECK(slink_envelope_count(&p) == 3);
+    uint8_t decoded[SLINK_MAX_PAYLOAD];
+    CHECK(slink_envelope_decode(&p, 0, decoded) == 0 && memcmp(decoded, samples[0], n) == 0);
+    CHECK(slink_envelope_decode(&p, 1, decoded) == 2 && decoded[1] == 127 && decoded[2] == 254 && decoded[3] == 126);
+    CHECK(slink_envelope_decode(&p, 2, decoded) == 4 && memcmp(decoded, samples[2], n) == 0);
+}
+
+static void testResync() {
+    SlinkParser p;
+    uint8_t payload[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t a[SLINK_MAX_FRAME], b[SLINK_MAX_FRAME];
+    int na = slink_encode(a, 10, SLINK_TYPE_HITS, payload, 6);
+    int nb = slink_encode(b, 11, SLINK_TYPE_HITS, payload, 3);
+
+    // garbage (including a sync byte with an invalid length) before a frame
+    slink_parser_init(&p);
+    const uint8_t garbage[] = { 0x00, 0x13, SLINK_SYNC, 0xF0, 0x42 };
+    CHECK(feed(&p, garbage, sizeof(garbage)) == 0);
+    CHECK(feed(&p, a, na) == 1 && p.seq == 10);
+    CHECK(p.syncErrors == 4 && p.crcErrors == 0);
+
+    // sync byte followed by a second sync byte as invalid length: the parser restarts at the second one
+    slink_parser_init(&p);
+    uint8_t doubled[SLINK_MAX_FRAME + 1] = { SLINK_SYNC };
+    memcpy(doubled + 1, a, na);
+    CHECK(feed(&p, doubled, na + 1) == 1);
+
+    // every single bit error is detected, the next frame is decoded
+    for (int byte = 1; byte < na; byte++) {
+        for (int bit = 0; bit < 8; bit++) {
+            slink_parser_init(&p);
+            uint8_t corrupted[SLINK_MAX_FRAME];
+            memcpy(corrupted, a, na);
+            corrupted[byte] ^= 1 << bit;
+            CHECK(feed(&p, corrupted, na) == 0);
+            int frames = 0;   // a corrupted (longer) length swallows up to SLINK_MAX_PAYLOAD bytes of the following frames
+            for (int k = 0; k < SLINK_MAX_FRAME / nb + 2; k++) frames += feed(&p, b, nb);
+            CHECK(frames >= 1);
+        }
+    }
+
+    // truncated frame: the following frame is consumed as its payload, the one after is decoded
+    slink_parser_init(&p);
+    CHECK(feed(&p, a, na - 3) == 0);
+    int frames = feed(&p, b, nb);
+    frames += feed(&p, b, nb);
+    frames += feed(&p, a, na);
+    CHECK(frames >= 1 && p.seq == 10);
+
+    // lost frames according to the sequence numbers
+    slink_parser_init(&p);
+    feed(&p, a, na);
+    uint8_t c[SLINK_MAX_FRAME];
+    int nc = slink_encode(c, 14, SLINK_TYPE_HITS, payload, 0);
+    feed(&p, c, nc);
+    CHECK(p.lostFrames == 3);
+    nc = slink_encode(c, 13, SLINK_TYPE_HITS, payload, 0);   // wrapped around: 254 frames lost
+    feed(&p, c, nc);
+    CHECK(p.lostFrames == 3 + 254);
+}
+
+// all payload helpers must stay within the received payload for any decoded frame
+static uint32_t exerciseHelpers(const SlinkParser *p) {
+    uint32_t sum = 0, timestamp;
+    uint8_t samples[256];
+    int channels = slink_states_channels(p);
+    for (int ch = 0; ch < channels; ch++) sum += slink_states_bit(p, ch);
+    if (p->len >= 1) sum += slink_states_age(p);
+    if (p->len >= 1 && slink_states_timestamp(p, &timestamp)) sum += timestamp;
+    for (int i = 0; i < slink_envelope_count(p); i++) sum += slink_envelope_decode(p, i, samples) + samples[0];
+    for (int i = 0; i < slink_hits_count(p); i++) sum += p->payload[i * SLINK_HIT_SIZE + 1];
+    for (int i = 0; i < slink_features_count(p); i++) sum += slink_get_u16(&p->payload[i * SLINK_FEATURES_SIZE + 5]);
+    CHECK(p->len <= SLINK_MAX_PAYLOAD);
+    return sum;
+}
+
+static void fuzz(long bytes, unsigned seed) {
+    SlinkParser p;
+    slink_parser_init(&p);
+    srand(seed);
+    uint8_t frame[SLINK_MAX_FRAME], payload[SLINK_MAX_PAYLOAD];
+    long fed = 0;
+    uint32_t sum = 0, embedded = 0, decoded = 0;
+
+    while (fed < bytes) {
+        int mode = rand() % 4;
+        if (mode == 0) {   // random bytes
+            int n = rand() % 200;
+            for (int i = 0; i < n; i++, fed++)
+                if (slink_parser_feed(&p, (uint8_t)rand())) sum += exerciseHelpers(&p);
+        }
+        else {   // valid frame with random content, mutated in half of the cases
+            int len = rand() % (SLINK_MAX_PAYLOAD + 1);
+            for (int i = 0; i < len; i++) payload[i] = (uint8_t)rand();
+            if (rand() & 1) payload[0] = (uint8_t)(rand() % 80);   // plausible channel / sample counts
+            uint8_t seq = (uint8_t)rand();
+            int n = slink_encode(frame, seq, (uint8_t)(rand() % 0x22), payload, len);
+            bool mutated = mode == 1;
+            if (mutated) frame[rand() % n] ^= (uint8_t)(1 + rand() % 255);
+            else embedded++;
+            for (int i = 0; i < n; i++, fed++) {
+                if (!slink_parser_feed(&p, frame[i])) continue;
+                sum += exerciseHelpers(&p);
+                if (!mutated && i == n - 1 && p.seq == seq) decoded++;
+            }
+        }
+    }
+    printf("fuzz: %ld bytes, %u frames decoded (%u of %u intact frames), %u crc errors, %u sync errors (checksum %u)\n",
+           fed, p.frames, decoded, embedded, p.crcErrors, p.syncErrors, sum);
+    CHECK(decoded * 10 >= embedded * 7);   // intact frames are only lost to a preceding corrupted length
+}
+
+int main(int argc, char **argv) {
+    long fuzzBytes = argc > 1 ? atol(argv[1]) : 10000000;
+    unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 1;
+
+    testCrc();
+    testRoundTrips();
+    testResync();
+    fuzz(fuzzBytes, seed);
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+/*
+   Neopixel Kalimba, for Zoom Museum Vienna, 2025
+   (c) Michael Strohmann and Chris Veigl
+
+    Host replay of recorded raw sensor traces through the FloorSensorReader DSP
+    (src/FloorSensorReader/sensordsp.h, the same code as on the Teensy3.2).
+
+    Record a trace: build the FloorSensorReader with CAPTURE_RAW_SAMPLES 1 and
+    SHOW_CHANNEL_TRACES 0, then save the USB Serial output to a file, e.g.
+      cat /dev/ttyACM0 > capture.bin
+    Text lines in the capture are ignored, the raw scans are found by the sync byte
+    and checksum of the telemetry records (see telemetry.h). The capture contains the
+    decimated means only, so the hit peaks are measured on them.
+
+    Build and run (tuning constants of sensordsp.h can be overridden with -D):
+      g++ -O2 -o replay tools/replay/replay.cpp
+      g++ -O2 -DSENSOR_NOISE_FACTOR=4 -DSENSOR_FAST_ONSET=0 -o replay tools/replay/replay.cpp
+      ./replay capture.bin [channels] [sample rate] [learn] [piezo|fsr]
+
+    With "learn", the crosstalk coefficients are learned from the whole capture first
+    (record the pads being hit one at a time) and printed, then the capture is replayed with them.
+    "piezo" or "fsr" selects the detector profile (default SENSOR_PROFILE).
+
+    Prints every trigger on/off event (time relative to the first scan, channel, trigger value),
+    the features of every hit, channels muted or enabled by the health check (sensorhealth.h),
+    the noise levels and thresholds after calibration, the fast onset statistics, the onsets
+    rejected by the footstep classifier and the processing time per scan and per sample.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "../../src/FloorSensorReader/sensordsp.h"
+#include "../../src/FloorSensorReader/sensorhealth.h"
+#include "../../src/FloorSensorReader/telemetry.h"
+
+struct Scan {
+    uint32_t time;
+    int raw[SENSORDSP_MAX_CHANNELS];
+};
+
+static int16_t getS16(const uint8_t *p) { return (int16_t)(p[0] | p[1] << 8); }
+static uint32_t getU32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+// Extract the TLM_RAW_SCAN records of a capture, records with the same timestamp form one scan
+static std::vector<Scan> readCapture(FILE *f, int channels, uint32_t *badRecords) {
+    std::vector<Scan> scans;
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+
+    *badRecords = 0;
+    for (size_t i = 0; i + TLM_RECORD_SIZE <= data.size(); ) {
+        const uint8_t *r = &data[i];
+        uint8_t check = 0;
+        if (r[0] == TLM_SYNC) for (int k = 0; k < TLM_RECORD_SIZE; k++) check ^= r[k];
+        if (r[0] != TLM_SYNC || check) {
+            if (r[0] == TLM_SYNC) (*badRecords)++;
+            i++;
+            continue;
+        }
+        i += TLM_RECORD_SIZE;
+        if (r[1] != TLM_RAW_SCAN || r[2] >= channels) continue;
+
+        uint32_t time = getU32(r + 4);
+        if (scans.empty() || scans.back().time != time) {
+            Scan scan;
+            scan.time = time;
+            memset(scan.raw, 0, sizeof(scan.raw));
+            if (!scans.empty()) memcpy(scan.raw, scans.back().raw, sizeof(scan.raw));   // a lost record repeats the previous values
+            scans.push_back(scan);
+        }
+        for (int k = 0; k < 4 && r[2] + k < channels; k++)
+            scans.back().raw[r[2] + k] = getS16(r + 8 + 2 * k);
+    }
+    return scans;
+}
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s capture.bin [channels (10)] [sample rate (1000)] [learn] [piezo|fsr]\n", argv[0]);
+        return 1;
+    }
+    int channels = argc > 2 ? atoi(argv[2]) : 10;
+    int sampleRate = argc > 3 ? atoi(argv[3]) : 1000;
+    bool learn = false;
+    int profile = SENSOR_PROFILE;
+    for (int a = 4; a < argc; a++) {
+        if (!strcmp(argv[a], "learn")) learn = true;
+        else if (!strcmp(argv[a], "piezo")) profile = SENSORDSP_PROFILE_PIEZO;
+        else if (!strcmp(argv[a], "fsr")) profile = SENSORDSP_PROFILE_FSR;
+    }
+    if (channels < 1 || channels > SENSORDSP_MAX_CHANNELS || sampleRate < 1) {
+        fprintf(stderr, "invalid number of channels or sample rate\n");
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    uint32_t badRecords;
+    std::vector<Scan> scans = readCapture(f, channels, &badRecords);
+    fclose(f);
+    if (scans.empty()) {
+        fprintf(stderr, "no raw scans found (record with CAPTURE_RAW_SAMPLES 1)\n");
+        return 1;
+    }
+
+    uint32_t gaps = 0;
+    for (size_t s = 1; s < scans.size(); s++)
+        if (scans[s].time - scans[s - 1].time > 1500000u / sampleRate) gaps++;
+    printf("%zu scans, %d channels, %d Hz, %u corrupted records, %u gaps\n",
+           scans.size(), channels, sampleRate, badRecords, gaps);
+
+    // run the scans through the DSP, collect the events
+    static SensorDsp dsp;
+    if (learn) {
+        sensordsp_init(&dsp, channels, sampleRate);
+        sensordsp_set_profile(&dsp, profile);
+        sensordsp_crosstalk_begin(&dsp);
+        for (size_t s = 0; s < scans.size(); s++) sensordsp_process(&dsp, scans[s].raw, NULL);
+        printf("%d crosstalk coefficients learned (%% of neighbours i-%d .. i+%d):\n",
+               sensordsp_crosstalk_end(&dsp), SENSOR_CROSSTALK_SPAN, SENSOR_CROSSTALK_SPAN);
+        for (int i = 0; i < channels; i++) {
+            printf("channel %2d:", i);
+            for (int k = 0; k < SENSORDSP_NEIGHBOURS; k++)
+                printf("%s %5.1f", k == SENSOR_CROSSTALK_SPAN ? "     -" : "",
+                       dsp.crosstalk[i][k] * 100.0 / (1 << SENSORDSP_CROSSTALK_SHIFT));
+            printf("\n");
+        }
+    }
+    int16_t crosstalk[SENSORDSP_MAX_CHANNELS][SENSORDSP_NEIGHBOURS];
+    memcpy(crosstalk, dsp.crosstalk, sizeof(crosstalk));
+    sensordsp_init(&dsp, channels, sampleRate);
+    sensordsp_set_profile(&dsp, profile);
+    memcpy(dsp.crosstalk, crosstalk, sizeof(crosstalk));
+    static SensorHealth health;
+    health_init(&health, channels, sampleRate);
+    uint32_t lastBits[SENSORDSP_WORDS] = {0};
+    uint32_t onsets = 0;
+    double processing = 0;
+
+    for (size_t s = 0; s < scans.size(); s++) {
+        double start = seconds();
+        int flags = sensordsp_process(&dsp, scans[s].raw, NULL);
+        processing += seconds() - start;
+
+        double ms = (scans[s].time - scans[0].time) / 1000.0;
+        if (flags & SENSORDSP_CALIBRATED) {
+            for (int i = 0; i < channels; i++)
+                printf("%10.1f ms  channel %2d: noise=%d, threshold=%d\n",
+                       ms, i, (int)(dsp.noiseLevel[i] >> 12), dsp.onThreshold[i]);
+        }
+        for (int i = 0; i < channels; i++) {
+            int bit = sensordsp_bit(&dsp, i);
+            if (bit == (int)((lastBits[i >> 5] >> (i & 31)) & 1)) continue;
+            if (bit) onsets++;
+            printf("%10.1f ms  channel %2d: %s (sensor=%d, trigger=%d)\n",
+                   ms, i, bit ? "on " : "off", dsp.sensorVal[i], dsp.triggers[i]);
+            lastBits[i >> 5] ^= 1UL << (i & 31);
+        }
+        if (health_update(&health, &dsp)) {
+            uint32_t wasMuted[SENSORDSP_WORDS];
+            memcpy(wasMuted, dsp.muted, sizeof(wasMuted));
+            health_evaluate(&health, &dsp);
+            for (int i = 0; i < channels; i++) {
+                uint32_t mask = 1UL << (i & 31);
+                if ((dsp.muted[i >> 5] ^ wasMuted[i >> 5]) & mask)
+                    printf("%10.1f ms  channel %2d: %s (%d onsets, noise rms %.2f)\n", ms, i,
+                           dsp.muted[i >> 5] & mask ? "muted" : "enabled again", health.lastOnsets[i], health.noiseRms[i] / 16.0);
+            }
+        }
+        for (int i = 0; (flags & SENSORDSP_HITS) && i < channels; i++) {
+            if (!(dsp.hitReady[i >> 5] & (1UL << (i & 31)))) continue;
+            printf("%10.1f ms  channel %2d: hit peak=%d rise=%dus energy=%u\n",
+                   ms, i, dsp.hitPeak[i], dsp.hitRise[i] * 1000000 / sampleRate, dsp.hitEnergy[i]);
+            dsp.hitReady[i >> 5] &= ~(1UL << (i & 31));
+        }
+    }
+
+    int median, maximum;
+    uint32_t total = sensordsp_lead_stats(&dsp, &median, &maximum);
+    printf("onsets=%u\n", onsets);
+    if (dsp.classifier) printf("slow loading rejected=%u\n", dsp.slowRejected);
+    if (SENSOR_FAST_ONSET)
+        printf("fast onset lead median=%dus max=%dus (%u onsets), rejected=%u\n",
+               median * 1000000 / sampleRate, maximum * 1000000 / sampleRate, total, dsp.fastRejected);
+    printf("processing: %.0f ns per scan, %.1f ns per sample\n",
+           processing * 1e9 / scans.size(), processing * 1e9 / scans.size() / channels);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Neopixel Kalimba, for Zoom Museum Vienna, 2025
+(c) Michael Strohmann and Chris Veigl
+
+Decoder for the binary telemetry records of the Teensy4.1 firmware and the
+FloorSensorReader (see src/FloorSensorReader/telemetry.h).
+
+Reads from a serial port (needs pyserial) or from a capture file and writes
+  - CSV (default): one line per record: time_us,type,id,v0,v1,v2,v3
+  - a Serial Plotter feed (--plotter): one line per set of channel traces,
+    e.g. for the Arduino Serial Plotter or any tool reading comma separated values
+
+Text lines interleaved with the records (status output of the firmware) are
+written to stderr.
+
+Examples:
+  python3 tools/telemetry_decode.py /dev/ttyACM0 > capture.csv
+  python3 tools/telemetry_decode.py /dev/ttyACM0 --plotter --fields signal,baseline
+  python3 tools/telemetry_decode.py capture.bin --types trigger,bigwave
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC = 0xA7
+RECORD_SIZE = 16
+FRAME_SYNC = b"\xA9\x46"   # frame stream packets (see tools/framestream_decode.py) are skipped
+FRAME_HEADER_SIZE = 9
+MAX_FRAME_PACKET = 6200
+
+TYPES = {
+    0x01: "trace",
+    0x02: "trigger",
+    0x03: "release",
+    0x04: "bigwave",
+    0x05: "performance",
+    0x06: "mode",
+    0x07: "raw",
+    0x08: "hit",
+    0x09: "health",
+}
+
+TRACE_FIELDS = ["signal", "baseline", "trigger", "sensor"]
+
+
+def records(stream, text_out):
+    """Yield (timestamp, type, id, values) tuples, pass other bytes to text_out."""
+    buf = bytearray()
+    text = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            break
+        buf += chunk
+        i = 0
+        while len(buf) - i >= RECORD_SIZE:
+            length = FRAME_HEADER_SIZE + (buf[i + 7] | buf[i + 8] << 8) + 1
+            if buf[i:i + 2] == FRAME_SYNC and length <= MAX_FRAME_PACKET:
+                if len(buf) - i < length:
+                    break
+                i += length
+                continue
+            if buf[i] == SYNC:
+                rec = buf[i:i + RECORD_SIZE]
+                check = 0
+                for b in rec:
+                    check ^= b
+                if check == 0 and rec[1] in TYPES:
+                    ts, v0, v1, v2, v3 = struct.unpack_from("<Ihhhh", rec, 4)
+                    yield ts, rec[1], rec[2], (v0, v1, v2, v3)
+                    i += RECORD_SIZE
+                    continue
+            text.append(buf[i])
+            if buf[i] == 0x0A:
+                text_out.write(text.decode("ascii", "replace"))
+                text_out.flush()
+                text.clear()
+            i += 1
+        del buf[:i]
+
+
+def open_input(name, baud):
+    if name == "-":
+        return sys.stdin.buffer
+    try:
+        return open(name, "rb")
+    except OSError:
+        import serial  # pyserial, only needed for live capture
+        return serial.Serial(name, baud, timeout=0.1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port, capture file or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200, help="baud rate (ignored by USB Serial)")
+    parser.add_argument("--types", help="comma separated record types to output (default: all)")
+    parser.add_argument("--plotter", action="store_true", help="output channel traces as Serial Plotter feed")
+    parser.add_argument("--fields", default="signal,baseline",
+                        help="trace fields for --plotter: " + ",".join(TRACE_FIELDS))
+    parser.add_argument("--channels", type=int, default=10, help="number of channels for --plotter")
+    args = parser.parse_args()
+
+    wanted = set(args.types.split(",")) if args.types else None
+    fields = [TRACE_FIELDS.index(f) for f in args.fields.split(",")]
+    out = sys.stdout
+
+    if not args.plotter:
+        out.write("time_us,type,id,v0,v1,v2,v3\n")
+
+    frame = {}
+    try:
+        for ts, rtype, rid, values in records(open_input(args.input, args.baud), sys.stderr):
+            name = TYPES[rtype]
+            if args.plotter:
+                if name != "trace" or rid >= args.channels:
+                    continue
+                if rid in frame:   # a channel repeats: the previous set is complete
+                    out.write(",".join(str(v) for c in sorted(frame) for v in frame[c]) + "\n")
+                    out.flush()
+                    frame = {}
+                frame[rid] = [values[f] for f in fields]
+            elif wanted is None or name in wanted:
+                out.write("%d,%s,%d,%d,%d,%d,%d\n" % ((ts, name, rid) + values))
+                out.flush()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()